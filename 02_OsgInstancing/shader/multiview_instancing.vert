@@ -0,0 +1,37 @@
+#version 150 compatibility
+#extension GL_ARB_uniform_buffer_object : enable
+layout(std140) uniform instanceData
+{
+	mat4 instanceModelMatrix[MAX_INSTANCES];
+};
+uniform mat4 multiViewModelViewProjectionMatrix[NUM_VIEWS];
+uniform mat3 multiViewNormalMatrix[NUM_VIEWS];
+uniform vec3 lightDirection;
+
+smooth out vec2 texCoord;
+smooth out vec3 normal;
+smooth out vec3 lightDir;
+
+out float gl_ClipDistance[2];
+
+void main()
+{
+	// consecutive instances share the same model matrix and are drawn into different views
+	int viewIndex = gl_InstanceID % NUM_VIEWS;
+	mat4 _instanceModelMatrix = instanceModelMatrix[gl_InstanceID / NUM_VIEWS];
+	vec4 position = multiViewModelViewProjectionMatrix[viewIndex] * _instanceModelMatrix * gl_Vertex;
+
+	// clip against the left and right border of the view and move it into its slice of the viewport
+	gl_ClipDistance[0] = position.w + position.x;
+	gl_ClipDistance[1] = position.w - position.x;
+	position.x = (position.x + position.w * float(2 * viewIndex + 1 - NUM_VIEWS)) / float(NUM_VIEWS);
+	gl_Position = position;
+	texCoord = gl_MultiTexCoord0.xy;
+
+	mat3 normalMatrix = mat3(_instanceModelMatrix[0][0], _instanceModelMatrix[0][1], _instanceModelMatrix[0][2],
+							 _instanceModelMatrix[1][0], _instanceModelMatrix[1][1], _instanceModelMatrix[1][2],
+							 _instanceModelMatrix[2][0], _instanceModelMatrix[2][1], _instanceModelMatrix[2][2]);
+
+	normal = multiViewNormalMatrix[viewIndex] * normalMatrix * gl_Normal;
+	lightDir = lightDirection;
+}
\ No newline at end of file
@@ -42,6 +42,7 @@
 #include "ComputeInstanceBoundingBoxCallback.h"
 #include "ComputeTextureBoundingBoxCallback.h"
 #include "MatrixUniformUpdateCallback.h"
+#include "MultiViewUniformUpdateCallback.h"
 
 namespace osgExample
 {
@@ -228,6 +229,50 @@ osg::ref_ptr<osg::Node> InstancedGeometryBuilder::getVertexAttribHardwareInstanc
 	return geode;
 }
 
+osg::ref_ptr<osg::Node> InstancedGeometryBuilder::getMultiViewHardwareInstancedNode(const std::vector<osg::Matrixd>& viewOffsets) const
+{
+	osg::ref_ptr<osg::Node> instancedNode;
+
+	unsigned int maxUBOMatrices = (m_maxUniformBlockSize / 64);
+
+	// first check if we need to split up the geometry in groups
+	if (m_matrices.size() <= maxUBOMatrices)
+	{
+		// we don't have more matrices than uniform space so we only need one geode
+		instancedNode = createMultiViewHardwareInstancedGeode(0, m_matrices.size(), maxUBOMatrices, viewOffsets);
+	} else {
+		// we need to split up instances into several geodes
+		osg::ref_ptr<osg::Group> group = new osg::Group;
+
+		unsigned int numGeodes = (m_matrices.size() + maxUBOMatrices - 1) / maxUBOMatrices;
+		for (unsigned int i = 0; i < numGeodes; ++i)
+		{
+			unsigned int start = i*maxUBOMatrices;
+			unsigned int end    = std::min((unsigned int)m_matrices.size(), (start + maxUBOMatrices));
+			group->addChild(createMultiViewHardwareInstancedGeode(start, end, maxUBOMatrices, viewOffsets));
+		}
+		instancedNode = group;
+	}
+
+	// add shaders
+	osg::ref_ptr<osg::Program> program = new osg::Program;
+	std::stringstream preprocessorDefinition;
+	preprocessorDefinition << "#define MAX_INSTANCES " << maxUBOMatrices << "\n"
+						   << "#define NUM_VIEWS " << viewOffsets.size();
+	osg::ref_ptr<osg::Shader> vsShader = readShaderFile("../shader/multiview_instancing.vert", preprocessorDefinition.str());
+	osg::ref_ptr<osg::Shader> fsShader = osgDB::readShaderFile("../shader/multiview_instancing.frag");
+	program->addShader(vsShader);
+	program->addShader(fsShader);
+	program->addBindUniformBlock("instanceData", 0);
+
+	// the vertex shader clips every view against the borders of its viewport slice
+	instancedNode->getOrCreateStateSet()->setAttributeAndModes(program, osg::StateAttribute::ON);
+	instancedNode->getOrCreateStateSet()->setMode(GL_CLIP_PLANE0, osg::StateAttribute::ON);
+	instancedNode->getOrCreateStateSet()->setMode(GL_CLIP_PLANE1, osg::StateAttribute::ON);
+
+	return instancedNode;
+}
+
 osg::ref_ptr<osg::Node> InstancedGeometryBuilder::createHardwareInstancedGeode(unsigned int start, unsigned int end) const
 {
 		// we don't have more matrices than uniform space so we only need one geode
@@ -371,6 +416,62 @@ osg::ref_ptr<osg::Node> InstancedGeometryBuilder::createUBOHardwareInstancedGeod
 	return geode;
 }
 
+osg::ref_ptr<osg::Node> InstancedGeometryBuilder::createMultiViewHardwareInstancedGeode(unsigned int start, unsigned int end, unsigned int maxUBOMatrices, const std::vector<osg::Matrixd>& viewOffsets) const
+{
+	osg::ref_ptr<osg::Geode>	geode = new osg::Geode;
+	osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry(*m_geometry, osg::CopyOp::DEEP_COPY_ALL);
+	geode->addDrawable(geometry);
+
+	// every instance is drawn once per view in the same draw call
+	for (unsigned int i = 0; i < geometry->getNumPrimitiveSets(); ++i)
+	{
+		geometry->getPrimitiveSet(i)->setNumInstances((end-start) * viewOffsets.size());
+	}
+
+	// we need to turn off display lists for instancing to work
+	geometry->setUseDisplayList(false);
+	geometry->setUseVertexBufferObjects(true);
+
+	// create uniform buffer object for all matrices
+	osg::FloatArray* matrixArray = new osg::FloatArray(maxUBOMatrices*16);
+	m_floatArrays.push_back(matrixArray);
+	for (unsigned int i = start, j = 0; i < end; ++i, ++j)
+	{
+		for (unsigned int k = 0; k < 16; ++k)
+		{
+			(*matrixArray)[j*16+k] =  m_matrices[i].ptr()[k];
+		}
+	}
+	osg::ref_ptr<osg::UniformBufferObject> ubo = new osg::UniformBufferObject;
+	ubo->setUsage(GL_STATIC_DRAW_ARB);
+	ubo->setDataVariance(osg::Object::STATIC);
+	matrixArray->setBufferObject(ubo);
+
+	// create uniform buffer binding and add it to the stateset
+	osg::ref_ptr<osg::UniformBufferBinding> ubb = new osg::UniformBufferBinding(0, ubo, 0, maxUBOMatrices*16*sizeof(GLfloat));
+	geode->getOrCreateStateSet()->setAttributeAndModes(ubb, osg::StateAttribute::ON);
+
+	// copy part of matrix list and create bounding box callback
+	std::vector<osg::Matrixd> matrices;
+	matrices.insert(matrices.begin(), m_matrices.begin()+start, m_matrices.begin()+end);
+	geometry->setComputeBoundingBoxCallback(new ComputeTextureBoundingBoxCallback(matrices));
+
+	// the views don't share the main camera frustum, so culling is done by the multi view callback of the parent group
+	geode->setCullingActive(false);
+
+	osg::ref_ptr<osg::Group> group = new osg::Group;
+	group->addChild(geode);
+	group->setCullingActive(false);
+
+	// add view matrix uniforms and cull callback
+	osg::ref_ptr<osgExample::MultiViewUniformUpdateCallback> cullCallback = new osgExample::MultiViewUniformUpdateCallback(viewOffsets);
+	group->getOrCreateStateSet()->addUniform(cullCallback->getModelViewProjectionMatricesUniform());
+	group->getOrCreateStateSet()->addUniform(cullCallback->getNormalMatricesUniform());
+	group->setCullCallback(cullCallback);
+
+	return group;
+}
+
 osg::ref_ptr<osg::Shader> InstancedGeometryBuilder::readShaderFile(const std::string& fileName, const std::string& preprocessorDefinitions) const
 {
 	// open vertex shader file
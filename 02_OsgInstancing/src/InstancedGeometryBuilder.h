@@ -66,11 +66,13 @@ public:
 	osg::ref_ptr<osg::Node> getTextureHardwareInstancedNode() const;
 	osg::ref_ptr<osg::Node> getUBOHardwareInstancedNode() const;
 	osg::ref_ptr<osg::Node> getVertexAttribHardwareInstancedNode() const;
+	osg::ref_ptr<osg::Node> getMultiViewHardwareInstancedNode(const std::vector<osg::Matrixd>& viewOffsets) const;
 
 private:
 	osg::ref_ptr<osg::Node>   createHardwareInstancedGeode(unsigned int start, unsigned int end) const;
 	osg::ref_ptr<osg::Node>   createTextureHardwareInstancedGeode(unsigned int start, unsigned int end) const;
 	osg::ref_ptr<osg::Node>	  createUBOHardwareInstancedGeode(unsigned int start, unsigned int end, unsigned int maxUBOMatrices) const;
+	osg::ref_ptr<osg::Node>	  createMultiViewHardwareInstancedGeode(unsigned int start, unsigned int end, unsigned int maxUBOMatrices, const std::vector<osg::Matrixd>& viewOffsets) const;
 	osg::ref_ptr<osg::Shader> readShaderFile(const std::string& fileName, const std::string& preprocessorDefinitions) const;
 
 	GLint						m_maxMatrixUniforms;
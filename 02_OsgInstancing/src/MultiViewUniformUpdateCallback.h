@@ -0,0 +1,83 @@
+#ifndef _MULTI_VIEW_UNIFORM_UPDATE_CALLBACK_H
+#define _MULTI_VIEW_UNIFORM_UPDATE_CALLBACK_H
+
+// std
+#include <vector>
+
+// osg
+#include <osg/ref_ptr>
+#include <osg/Node>
+#include <osgUtil/CullVisitor>
+#include <osg/Uniform>
+#include <osg/Matrix>
+#include <osg/Polytope>
+
+namespace osgExample
+{
+
+/**
+	@brief Cull callback for multi view instancing.
+	Fills one model view projection and normal matrix per view and culls the subgraph once against the combined frustum of all views.
+	Each view is rendered into its own horizontal slice of the viewport, so the projection is widened to keep the aspect ratio.
+*/
+class MultiViewUniformUpdateCallback : public osg::NodeCallback
+{
+public:
+	MultiViewUniformUpdateCallback(const std::vector<osg::Matrixd>& viewOffsets)
+		: m_viewOffsets(viewOffsets)
+	{
+		m_modelViewProjectionMatrices = new osg::Uniform(osg::Uniform::FLOAT_MAT4, "multiViewModelViewProjectionMatrix", m_viewOffsets.size());
+		m_normalMatrices			  = new osg::Uniform(osg::Uniform::FLOAT_MAT3, "multiViewNormalMatrix", m_viewOffsets.size());
+	}
+
+	virtual void operator()(osg::Node* node, osg::NodeVisitor* nv)
+    {
+		osg::ref_ptr<osgUtil::CullVisitor> cv = dynamic_cast<osgUtil::CullVisitor*>(nv);
+
+		if(cv)
+		{
+			osg::Matrixd projectionMatrix = *cv->getProjectionMatrix() * osg::Matrixd::scale(m_viewOffsets.size(), 1.0, 1.0);
+			osg::Matrixd modelViewMatrix  = *cv->getModelViewMatrix();
+
+			bool visible = false;
+			for (unsigned int i = 0; i < m_viewOffsets.size(); ++i)
+			{
+				osg::Matrixd viewModelViewMatrix = modelViewMatrix * m_viewOffsets[i];
+				osg::Matrixd viewModelViewProjectionMatrix = viewModelViewMatrix * projectionMatrix;
+				osg::Matrix3 normalMatrix(viewModelViewMatrix(0, 0), viewModelViewMatrix(0, 1), viewModelViewMatrix(0, 2),
+										  viewModelViewMatrix(1, 0), viewModelViewMatrix(1, 1), viewModelViewMatrix(1, 2),
+										  viewModelViewMatrix(2, 0), viewModelViewMatrix(2, 1), viewModelViewMatrix(2, 2));
+
+				m_modelViewProjectionMatrices->setElement(i, osg::Matrixf(viewModelViewProjectionMatrix));
+				m_normalMatrices->setElement(i, normalMatrix);
+
+				// the subgraph is visible if any of the view frustums contains it
+				if (!visible)
+				{
+					osg::Polytope frustum;
+					frustum.setToUnitFrustum();
+					frustum.transformProvidingInverse(viewModelViewProjectionMatrix);
+					visible = frustum.contains(node->getBound());
+				}
+			}
+
+			if (!visible)
+				return;
+		}
+
+		traverse(node, nv);
+    }
+
+	inline osg::ref_ptr<osg::Uniform> getModelViewProjectionMatricesUniform() const { return m_modelViewProjectionMatrices; }
+	inline osg::ref_ptr<osg::Uniform> getNormalMatricesUniform() const { return m_normalMatrices; }
+	inline unsigned int getNumViews() const { return m_viewOffsets.size(); }
+
+private:
+	std::vector<osg::Matrixd>  m_viewOffsets;
+	osg::ref_ptr<osg::Uniform> m_modelViewProjectionMatrices;
+	osg::ref_ptr<osg::Uniform> m_normalMatrices;
+};
+
+} // namespae osgExample
+
+#endif
@@ -56,34 +56,40 @@ public:
 			{
 			case osgGA::GUIEventAdapter::KEY_1:
 				m_switch->setSingleChildOn(0);
-				m_switch->setValue(5, true);
+				m_switch->setValue(6, true);
 				std::cout << "Switched to software instancing" << std::endl;
 				return true;
 				break;
 			case osgGA::GUIEventAdapter::KEY_2:
 				m_switch->setSingleChildOn(1);
-				m_switch->setValue(5, true);
+				m_switch->setValue(6, true);
 				std::cout << "Switched to hardware instancing with uniforms" << std::endl;
 				return true;
 				break;
 			case osgGA::GUIEventAdapter::KEY_3:
 				m_switch->setSingleChildOn(2);
-				m_switch->setValue(5, true);
+				m_switch->setValue(6, true);
 				std::cout << "Switched to hardware instancing with textures" << std::endl;
 				return true;
 				break;
 			case osgGA::GUIEventAdapter::KEY_4:
 				m_switch->setSingleChildOn(3);
-				m_switch->setValue(5, true);
+				m_switch->setValue(6, true);
 				std::cout << "Switched to hardware instancing with uniform buffer objects" << std::endl;
 				return true;
 				break;
 			case osgGA::GUIEventAdapter::KEY_5:
 				m_switch->setSingleChildOn(4);
-				m_switch->setValue(5, true);
+				m_switch->setValue(6, true);
 				std::cout << "Switched to hardware instancing with vertex attribute divisor" << std::endl;
 				return true;
 				break;
+			case osgGA::GUIEventAdapter::KEY_6:
+				m_switch->setSingleChildOn(5);
+				m_switch->setValue(6, true);
+				std::cout << "Switched to single pass multi view hardware instancing" << std::endl;
+				return true;
+				break;
 			case osgGA::GUIEventAdapter::KEY_Plus:
 				m_size *= 2.0f;
 				m_size = std::min(std::max(m_size, 8.0f), 1024.0f);
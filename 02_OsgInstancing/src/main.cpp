@@ -44,6 +44,7 @@
 #include <osgDB/ReadFile>
 #include <osg/Light>
 #include <osg/LightSource>
+#include <osg/DisplaySettings>
 
 // osgExample
 #include "InstancedGeometryBuilder.h"
@@ -170,6 +171,13 @@ osg::ref_ptr<osg::Switch> setupScene(unsigned int x, unsigned int y)
 	switchNode->addChild(g_builder->getUBOHardwareInstancedNode(), false);
 	switchNode->addChild(g_builder->getVertexAttribHardwareInstancedNode(), true);
 
+	// render a side by side stereo pair in a single pass
+	float eyeSeparation = osg::DisplaySettings::instance()->getEyeSeparation();
+	std::vector<osg::Matrixd> viewOffsets;
+	viewOffsets.push_back(osg::Matrixd::translate( eyeSeparation * 0.5f, 0.0f, 0.0f));
+	viewOffsets.push_back(osg::Matrixd::translate(-eyeSeparation * 0.5f, 0.0f, 0.0f));
+	switchNode->addChild(g_builder->getMultiViewHardwareInstancedNode(viewOffsets), false);
+
 	// load texture and add it to the quad
 	osg::ref_ptr<osg::Image> image = osgDB::readImageFile("../data/grass.png");
 	osg::ref_ptr<osg::Texture2D> texture = new osg::Texture2D(image);
@@ -244,7 +252,7 @@ int main(int argc, char** argv)
 	// print usage
 	std::cout << "OpenSceneraph Instancing Example" << std::endl;
 	std::cout << "================================" << std::endl << std::endl;
-	std::cout << "Switch between instancing techniques: 1, 2, 3, 4, 5" << std::endl;
+	std::cout << "Switch between instancing techniques: 1, 2, 3, 4, 5, 6" << std::endl;
 	std::cout << "Increase/decrease scene complexety: +/-" << std::endl;
 	std::cout << "Cycle through different status informations(FPS and other stats): s" << std::endl;
 
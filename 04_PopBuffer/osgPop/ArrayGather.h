@@ -0,0 +1,140 @@
+#pragma once
+
+// std
+#include <vector>
+#include <cstring>
+
+#include <osg/Array>
+#include <osg/Geometry>
+
+namespace osgUtil
+{
+
+template<size_t ElementSize> void _gatherElements(unsigned char* dst, const unsigned char* src, const unsigned int* elements, size_t numElements)
+{
+	for (size_t i = 0; i < numElements; ++i)
+	{
+		memcpy(dst + i * ElementSize, src + size_t(elements[i]) * ElementSize, ElementSize);
+	}
+}
+
+/**
+ @brief copies element elements[i] of src to element i of dst.
+ The common element sizes are copied with a constant size, which the compiler turns into plain loads and stores.
+*/
+inline void gatherElements(void* dst, const void* src, unsigned int elementSize, const unsigned int* elements, size_t numElements)
+{
+	unsigned char* d = static_cast<unsigned char*>(dst);
+	const unsigned char* s = static_cast<const unsigned char*>(src);
+
+	switch (elementSize)
+	{
+	case 1: _gatherElements<1>(d, s, elements, numElements); break;
+	case 2: _gatherElements<2>(d, s, elements, numElements); break;
+	case 3: _gatherElements<3>(d, s, elements, numElements); break;
+	case 4: _gatherElements<4>(d, s, elements, numElements); break;
+	case 6: _gatherElements<6>(d, s, elements, numElements); break;
+	case 8: _gatherElements<8>(d, s, elements, numElements); break;
+	case 12: _gatherElements<12>(d, s, elements, numElements); break;
+	case 16: _gatherElements<16>(d, s, elements, numElements); break;
+	case 24: _gatherElements<24>(d, s, elements, numElements); break;
+	case 32: _gatherElements<32>(d, s, elements, numElements); break;
+	default:
+		for (size_t i = 0; i < numElements; ++i)
+		{
+			memcpy(d + i * elementSize, s + size_t(elements[i]) * elementSize, elementSize);
+		}
+	}
+}
+
+/**
+ @brief Gathers the per vertex arrays of a geometry through one index table.
+ Every array is collected once, in the order vertices, normals, colors, secondary colors, fog coordinates,
+ texture coordinates and vertex attributes. Gathering allocates each new array with its final size and copies its elements
+ bytewise, so it works for every array type without a switch over the types and without one call per element.
+*/
+class ArrayGather
+{
+public:
+	explicit ArrayGather(const osg::Geometry& geometry)
+		: _numTexCoordArrays(geometry.getNumTexCoordArrays())
+		, _numVertices(geometry.getVertexArray() ? geometry.getVertexArray()->getNumElements() : 0)
+	{
+		_sources.push_back(geometry.getVertexArray());
+		_sources.push_back(geometry.getNormalArray());
+		_sources.push_back(geometry.getColorArray());
+		_sources.push_back(geometry.getSecondaryColorArray());
+		_sources.push_back(geometry.getFogCoordArray());
+		for (unsigned int i = 0; i < geometry.getNumTexCoordArrays(); ++i) { _sources.push_back(geometry.getTexCoordArray(i)); }
+		for (unsigned int i = 0; i < geometry.getNumVertexAttribArrays(); ++i) { _sources.push_back(geometry.getVertexAttribArray(i)); }
+	}
+
+	/** @brief arrays bound per vertex with one element per vertex of the geometry */
+	inline bool isPerVertex(const osg::Array* array) const
+	{
+		return array && array->getBinding() == osg::Array::BIND_PER_VERTEX && array->getNumElements() == _numVertices;
+	}
+
+	inline const std::vector<osg::ref_ptr<const osg::Array> >& getSourceArrays() const { return _sources; }
+
+	/**
+	 @brief creates a new array for every per vertex array, with element elements[i] of the source at i.
+	 Arrays that are not per vertex are shared, missing arrays stay NULL.
+	*/
+	std::vector<osg::ref_ptr<osg::Array> > gather(const std::vector<unsigned int>& elements) const
+	{
+		std::vector<osg::ref_ptr<osg::Array> > arrays;
+		arrays.reserve(_sources.size());
+		for (auto& source: _sources)
+		{
+			if (isPerVertex(source.get())) { arrays.push_back(gatherArray(source.get(), elements)); }
+			else { arrays.push_back(const_cast<osg::Array*>(source.get())); }
+		}
+		return arrays;
+	}
+
+	/** @brief sets arrays in the order of the source arrays to the geometry, NULL arrays are skipped */
+	void setArrays(osg::Geometry& geometry, const std::vector<osg::ref_ptr<osg::Array> >& arrays) const
+	{
+		for (size_t i = 0; i < arrays.size(); ++i)
+		{
+			osg::Array* array = arrays[i].get();
+			if (!array) { continue; }
+
+			if (i == 0) { geometry.setVertexArray(array); }
+			else if (i == 1) { geometry.setNormalArray(array); }
+			else if (i == 2) { geometry.setColorArray(array); }
+			else if (i == 3) { geometry.setSecondaryColorArray(array); }
+			else if (i == 4) { geometry.setFogCoordArray(array); }
+			else if (i < 5 + _numTexCoordArrays) { geometry.setTexCoordArray(i - 5, array); }
+			else { geometry.setVertexAttribArray(i - 5 - _numTexCoordArrays, array); }
+		}
+	}
+
+	/** @brief copies element elements[i] of source to i of a new array of the same type, binding and normalization */
+	static osg::ref_ptr<osg::Array> gatherArray(const osg::Array* source, const std::vector<unsigned int>& elements)
+	{
+		if (!source) { return NULL; }
+
+		osg::ref_ptr<osg::Array> destination = dynamic_cast<osg::Array*>(source->cloneType());
+		if (!destination) { return NULL; }
+		destination->setBinding(source->getBinding());
+		destination->setNormalize(source->getNormalize());
+		destination->resizeArray(elements.size());
+
+		if (!elements.empty())
+		{
+			gatherElements(const_cast<GLvoid*>(destination->getDataPointer()), source->getDataPointer(),
+			               source->getElementSize(), &elements.front(), elements.size());
+		}
+
+		return destination;
+	}
+
+private:
+	std::vector<osg::ref_ptr<const osg::Array> > _sources;
+	unsigned int _numTexCoordArrays;
+	unsigned int _numVertices;
+};
+
+}
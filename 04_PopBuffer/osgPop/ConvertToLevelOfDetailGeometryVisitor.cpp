@@ -1,6 +1,9 @@
 #include "ConvertToLevelOfDetailGeometryVisitor.h"
 #include "LevelOfDetailDrawElements.h"
 #include "HalfEdge.h"
+#include "ParallelFor.h"
+#include "VertexCacheOptimizer.h"
+#include "ArrayGather.h"
 
 #include <osg/Array>
 #include <osg/Geode>
@@ -9,6 +12,11 @@
 #include <iostream>
 #include <memory>
 #include <cmath>
+#include <climits>
+#include <algorithm>
+#include <mutex>
+#include <unordered_set>
+#include <cstring>
 
 using namespace std;
 using namespace osg;
@@ -16,8 +24,17 @@ using namespace osg;
 namespace osgUtil
 {
 
+static mutex stateSetMergeMutex;
+
 void ConvertToLevelOfDetailGeometryVisitor::apply(Geode& geode)
 {
+	// only gather geodes for the parallel conversion
+	if (_collectGeodes)
+	{
+		_geodes.push_back(&geode);
+		return;
+	}
+
 	// convert all geometries to lod geometries
 	vector<ref_ptr<LevelOfDetailGeometry> > lodGeometries;
 	for (size_t i = 0; i < geode.getNumDrawables(); ++i)
@@ -39,6 +56,138 @@ void ConvertToLevelOfDetailGeometryVisitor::apply(Geode& geode)
 	}
 }
 
+void ConvertToLevelOfDetailGeometryVisitor::convertParallel(Node& node, unsigned int numThreads)
+{
+	// neighbouring geometries have to share the grid of their compressed vertices
+	if (_compressAttributes) { computeCompressionGrid(node); }
+
+	// gather all geodes first
+	_collectGeodes = true;
+	_geodes.clear();
+	node.accept(*this);
+	_collectGeodes = false;
+
+	// geodes with several parents are visited more than once, the first visit is done in parallel
+	vector<ref_ptr<Geode> > geodes;
+	vector<ref_ptr<Geode> > revisitedGeodes;
+	unordered_set<Geode*> visitedGeodes;
+	for (size_t i = 0; i < _geodes.size(); ++i)
+	{
+		if (visitedGeodes.insert(_geodes[i].get()).second)
+		{
+			geodes.push_back(_geodes[i]);
+		} else {
+			revisitedGeodes.push_back(_geodes[i]);
+		}
+	}
+	_geodes.clear();
+
+	vector<ref_ptr<Geometry> > geometries;
+	vector<size_t> firstGeometry;
+	for (auto geode: geodes)
+	{
+		firstGeometry.push_back(geometries.size());
+		for (size_t i = 0; i < geode->getNumDrawables(); ++i)
+		{
+			ref_ptr<Geometry> geometry = dynamic_cast<Geometry*>(geode->getDrawable(i));
+
+			if (geometry)
+			{
+				// computing the bound lazily would write to geometries shared between threads
+				geometry->getBound();
+				geometries.push_back(geometry);
+			}
+		}
+	}
+	firstGeometry.push_back(geometries.size());
+
+	// conversions are independent of each other
+	vector<ref_ptr<LevelOfDetailGeometry> > lodGeometries(geometries.size());
+	parallelFor(geometries.size(), numThreads, [&](size_t i)
+	{
+		lodGeometries[i] = convert(geometries[i]);
+	});
+
+	// replace geometries of the geodes in the original order
+	for (size_t i = 0; i < geodes.size(); ++i)
+	{
+		geodes[i]->removeDrawables(0, geodes[i]->getNumDrawables());
+
+		for (size_t j = firstGeometry[i]; j < firstGeometry[i+1]; ++j)
+		{
+			geodes[i]->addDrawable(lodGeometries[j]);
+		}
+	}
+
+	// the serial traversal converts shared geodes again on every further visit
+	for (auto geode: revisitedGeodes)
+	{
+		apply(*geode);
+	}
+}
+
+/**
+ @brief grid steps that fit an extent into 65533 steps, two less than a short holds, so a geometry fits even if its
+ bounds start and end between two grid lines. Flat extents fall back to the extent of the scene.
+*/
+static Vec3 compressionStep(const Vec3& extent, const Vec3& sceneExtent)
+{
+	Vec3 step;
+	for (int i = 0; i < 3; ++i)
+	{
+		float axisExtent = (extent[i] > 0.0f) ? extent[i] : sceneExtent[i];
+		step[i] = (axisExtent > 0.0f) ? axisExtent / 65533.0f : 1.0f;
+	}
+	return step;
+}
+
+static void setQuantizationBounds(ref_ptr<LevelOfDetailGeometry> lodGeometry, const BoundingBox& bounds)
+{
+	Vec3 min = bounds._min;
+	Vec3 max = bounds._max;
+	for (int i = 0; i < 3; ++i)
+	{
+		// all vertices of a flat axis quantize to min, any extent avoids the division by zero
+		if (!(max[i] > min[i])) { max[i] = min[i] + 1.0f; }
+	}
+	lodGeometry->setMinBounds(min);
+	lodGeometry->setMaxBounds(max);
+}
+
+void ConvertToLevelOfDetailGeometryVisitor::computeCompressionGrid(Node& node)
+{
+	// gather all geodes first
+	_collectGeodes = true;
+	_geodes.clear();
+	node.accept(*this);
+	_collectGeodes = false;
+
+	// the grid starts at the bounds of the scene, its steps fit the largest geometry into 16 bits on every axis
+	BoundingBox sceneBounds;
+	Vec3 maxExtent(0.0f, 0.0f, 0.0f);
+	for (auto geode: _geodes)
+	{
+		for (size_t i = 0; i < geode->getNumDrawables(); ++i)
+		{
+			Geometry* geometry = dynamic_cast<Geometry*>(geode->getDrawable(i));
+			if (!geometry || !geometry->getVertexArray()) { continue; }
+
+			const BoundingBox& bounds = geometry->getBound();
+			if (!bounds.valid()) { continue; }
+
+			sceneBounds.expandBy(bounds);
+			for (int j = 0; j < 3; ++j) { maxExtent[j] = std::max(maxExtent[j], bounds._max[j] - bounds._min[j]); }
+		}
+	}
+	_geodes.clear();
+
+	_hasCompressionGrid = sceneBounds.valid();
+	if (!_hasCompressionGrid) { return; }
+
+	_compressionOrigin = sceneBounds._min;
+	_compressionStep = compressionStep(maxExtent, sceneBounds._max - sceneBounds._min);
+}
+
 ref_ptr<LevelOfDetailGeometry> ConvertToLevelOfDetailGeometryVisitor::convert(ref_ptr<Geometry> geometry) const
 {
 	// assertions
@@ -48,18 +197,15 @@ ref_ptr<LevelOfDetailGeometry> ConvertToLevelOfDetailGeometryVisitor::convert(re
 	// create lod geometry
 	ref_ptr<LevelOfDetailGeometry> lodGeometry = new LevelOfDetailGeometry();
 
-	// merge state sets
+	// merge state sets, shared state attributes register their new parent, so only one thread at a time may merge
 	if (geometry->getStateSet())
 	{	
+		lock_guard<mutex> lock(stateSetMergeMutex);
 		lodGeometry->getOrCreateStateSet()->merge(*geometry->getStateSet());
 	}
 	
-	// compute bounding box and set min and max bounds
-	BoundingBox bounds = geometry->getBound();
-	float min =  std::min(bounds.xMin(), std::min(bounds.yMin(), bounds.zMin()));
-	float max =  std::max(bounds.xMax(), std::max(bounds.yMax(), bounds.zMax()));
-	lodGeometry->setMinBounds(min);
-	lodGeometry->setMaxBounds(max);
+	// compute bounding box and quantize every axis within its own extent, so flat and thin meshes keep their precision
+	setQuantizationBounds(lodGeometry, geometry->getBound());
 
     // collect half edges
     vector<HalfEdge> halfEdges;
@@ -68,9 +214,21 @@ ref_ptr<LevelOfDetailGeometry> ConvertToLevelOfDetailGeometryVisitor::convert(re
     // find half edges opposites sort protected vertices to the front
 	findHalfEdgeOpposite(&halfEdges);    
     findAndSortProtectedVertices(geometry, lodGeometry, &halfEdges);
+
+    // the lods of compressed vertices are built from the positions the shader decodes
+    if (_compressAttributes) { snapToCompressionGrid(lodGeometry); }
     
 	// collect triangles and create list sorted by LODs
-    if (!collectLod(lodGeometry, min, max, lodGeometry->getNumberOfProtectedVertices())) { return NULL; }
+    if (!collectLod(lodGeometry, lodGeometry->getMinBounds(), lodGeometry->getMaxBounds(), lodGeometry->getNumberOfProtectedVertices())) { return NULL; }
+
+    // sort regular vertices by the lod that uses them first, so coarse lods only touch the front of the vertex buffer
+    sortVerticesByLod(lodGeometry);
+
+    // measure the error of every lod for the lod selection
+    measureLodErrors(lodGeometry);
+
+    // compress the attributes after everything that reads the original vertices
+    if (_compressAttributes) { compressAttributes(lodGeometry); }
 
     // recompute bounds
 	lodGeometry->computeBound();
@@ -86,6 +244,15 @@ template<class VertexArray, class Vector> void _collectHalfEdges(osg::ref_ptr<os
 	triangleCollector._vertexArray = dynamic_cast<VertexArray*>(geometry->getVertexArray());
     triangleCollector._halfEdges = halfEdges;
 
+	// there are at most as many welded vertices as vertices in the array
+	triangleCollector._vertexIDMap.reserve(geometry->getVertexArray()->getNumElements());
+	size_t numIndices = 0;
+	for (size_t i = 0; i < geometry->getNumPrimitiveSets(); ++i)
+	{
+		numIndices += geometry->getPrimitiveSet(i)->getNumIndices();
+	}
+	halfEdges->reserve(numIndices);
+
 	for (size_t i = 0; i < geometry->getNumPrimitiveSets(); ++i)
 	{
         ref_ptr<PrimitiveSet> primtive = geometry->getPrimitiveSet(i);
@@ -127,8 +294,17 @@ bool ConvertToLevelOfDetailGeometryVisitor::collectHalfEdges(osg::ref_ptr<osg::G
 	return true;
 }
 
-ref_ptr<PrimitiveSet>  createLevelOfDetailDrawPrimitive(vector<ref_ptr<DrawElementsUInt> >* drawElements, size_t numVertices)
+ref_ptr<PrimitiveSet>  createLevelOfDetailDrawPrimitive(vector<ref_ptr<DrawElementsUInt> >* drawElements, size_t numVertices, bool reorderTriangles)
 {
+    // the triangles of a lod are in the order the functor visited them, reorder every lod on its own for the vertex cache
+    if (reorderTriangles)
+    {
+        for (auto lodDrawElements: *drawElements)
+        {
+            if (!lodDrawElements->empty()) { optimizeVertexCache(&lodDrawElements->front(), lodDrawElements->size()); }
+        }
+    }
+
     // first merge geometry in a UInt draw element
 	ref_ptr<LevelOfDetailDrawElementsUInt> lodDrawElements = new LevelOfDetailDrawElementsUInt(GL_TRIANGLES);
 
@@ -177,9 +353,10 @@ ref_ptr<PrimitiveSet>  createLevelOfDetailDrawPrimitive(vector<ref_ptr<DrawEleme
 }
 
 template<class VertexArray, class Vector> void _collectLod(ref_ptr<Geometry> geometry,
-														   float min,
-														   float max,
-                                                           int numProtectedVertices)
+														   const Vec3& min,
+														   const Vec3& max,
+                                                           int numProtectedVertices,
+                                                           bool optimizeVertexCache)
 {
     vector<ref_ptr<PrimitiveSet> > drawElements;
     size_t numVertices = geometry->getVertexArray()->getNumElements();
@@ -188,8 +365,7 @@ template<class VertexArray, class Vector> void _collectLod(ref_ptr<Geometry> geo
 
         TriangleIndexFunctor<LodTriangleCollector<VertexArray, Vector> > triangleCollector;
 	    triangleCollector._vertexArray = dynamic_cast<VertexArray*>(geometry->getVertexArray());
-	    triangleCollector._min = min;
-	    triangleCollector._max = max;
+	    triangleCollector.setBounds(min, max);
         triangleCollector._numProtectedVertices = numProtectedVertices;
 
         vector<ref_ptr<DrawElementsUInt> > lodDrawElements;
@@ -200,8 +376,9 @@ template<class VertexArray, class Vector> void _collectLod(ref_ptr<Geometry> geo
         triangleCollector._lodDrawElements = &lodDrawElements;
 	
 		
-        geometry->getPrimitiveSet(i)->accept(triangleCollector);        
-        drawElements.push_back(createLevelOfDetailDrawPrimitive(&lodDrawElements, numVertices));
+        geometry->getPrimitiveSet(i)->accept(triangleCollector);
+        triangleCollector.flush();
+        drawElements.push_back(createLevelOfDetailDrawPrimitive(&lodDrawElements, numVertices, optimizeVertexCache));
 	}
 
     // switch draw primitives
@@ -214,27 +391,27 @@ template<class VertexArray, class Vector> void _collectLod(ref_ptr<Geometry> geo
 }
 
 bool ConvertToLevelOfDetailGeometryVisitor::collectLod(ref_ptr<Geometry> geometry,
-											 float min,
-											 float max,
+											 const Vec3& min,
+											 const Vec3& max,
                                              int numProtectedVertices) const
 {
 	switch(geometry->getVertexArray()->getType())
 	{
 		case Array::Vec3ArrayType:
 		{
-			_collectLod<Vec3Array, Vec3>(geometry, min, max, numProtectedVertices);
+			_collectLod<Vec3Array, Vec3>(geometry, min, max, numProtectedVertices, _optimizeVertexCache);
 		} break;
 		case Array::Vec3dArrayType:
 		{
-			_collectLod<Vec3dArray, Vec3d>(geometry, min, max, numProtectedVertices);
+			_collectLod<Vec3dArray, Vec3d>(geometry, min, max, numProtectedVertices, _optimizeVertexCache);
 		} break;
 		case Array::Vec3bArrayType:
 		{
-			_collectLod<Vec3bArray, Vec3b>(geometry, min, max, numProtectedVertices);
+			_collectLod<Vec3bArray, Vec3b>(geometry, min, max, numProtectedVertices, _optimizeVertexCache);
 		} break;
 		case Array::Vec3sArrayType:
 		{
-			_collectLod<Vec3sArray, Vec3s>(geometry, min, max, numProtectedVertices);
+			_collectLod<Vec3sArray, Vec3s>(geometry, min, max, numProtectedVertices, _optimizeVertexCache);
 		} break;
 		default:
 			// unknown vertex format
@@ -247,63 +424,37 @@ bool ConvertToLevelOfDetailGeometryVisitor::collectLod(ref_ptr<Geometry> geometr
 
 void ConvertToLevelOfDetailGeometryVisitor::findHalfEdgeOpposite(vector<HalfEdge>* halfEdges) const
 {
-	map<pair<unsigned int, unsigned int>, size_t> oppositeMap;
+	// edges are keyed by both vertex IDs packed into 64 bits
+	HashMap<uint64_t, size_t, IntegerHash> oppositeMap(halfEdges->size());
 
 	for (size_t i = 0; i < halfEdges->size(); ++i)
 	{
 		HalfEdge* halfEdge = &halfEdges->at(i);
-		pair<unsigned int, unsigned int> index(halfEdge->vertexID, halfEdges->at(halfEdge->next).vertexID);
-		pair<unsigned int, unsigned int> oppositeIndex(halfEdges->at(halfEdge->next).vertexID, halfEdge->vertexID);
+		uint64_t vertexID = halfEdge->vertexID;
+		uint64_t nextVertexID = halfEdges->at(halfEdge->next).vertexID;
 
-		oppositeMap[index] = i;
+		oppositeMap[(vertexID << 32) | nextVertexID] = i;
 
 		// try to find the opposite half edge
-		auto oppositeIt = oppositeMap.find(oppositeIndex);
-		if (oppositeIt != oppositeMap.end())
+		size_t* opposite = oppositeMap.find((nextVertexID << 32) | vertexID);
+		if (opposite)
 		{
-			halfEdge->opposite = oppositeIt->second;
-			halfEdges->at(oppositeIt->second).opposite = i;
+			halfEdge->opposite = *opposite;
+			halfEdges->at(*opposite).opposite = i;
 		}
 	}	
 }
 
 void ConvertToLevelOfDetailGeometryVisitor::findAndSortProtectedVertices(ref_ptr<Geometry> geometry, ref_ptr<LevelOfDetailGeometry> lodGeometry, std::vector<HalfEdge>* halfEdges) const
 {
-    ref_ptr<Array> vertexArray = geometry->getVertexArray();
-	ref_ptr<Array> normalArray = geometry->getNormalArray();
-	ref_ptr<Array> colorArray = geometry->getColorArray();
-	ref_ptr<Array> secondaryColorArray = geometry->getSecondaryColorArray();
-	ref_ptr<Array> fogCoordArray = geometry->getFogCoordArray();
-	Geometry::ArrayList& texCoordArrays = geometry->getTexCoordArrayList();
-	Geometry::ArrayList& vertexAttribArrays = geometry->getVertexAttribArrayList();	
-
-	ref_ptr<Array> protectedVertices = createArrayOfType(vertexArray);
-	ref_ptr<Array> regularVertices = createArrayOfType(vertexArray);
-	ref_ptr<Array> protectedNormals = createArrayOfType(normalArray);
-	ref_ptr<Array> regularNormals = createArrayOfType(normalArray);
-	ref_ptr<Array> protectedColors = createArrayOfType(colorArray);
-	ref_ptr<Array> regularColors = createArrayOfType(colorArray);
-	ref_ptr<Array> protectedSecondaryColors = createArrayOfType(secondaryColorArray);
-	ref_ptr<Array> regularSecondaryColors = createArrayOfType(secondaryColorArray);
-	ref_ptr<Array> protectedFogCoords = createArrayOfType(fogCoordArray);
-	ref_ptr<Array> regularFogCoords = createArrayOfType(fogCoordArray);
-	vector<ref_ptr<Array> > protectedTexCoords;
-	vector<ref_ptr<Array> > regularTexCoords;
-	for (auto texCoordArray: texCoordArrays)
-	{
-		protectedTexCoords.push_back(createArrayOfType(texCoordArray));
-		regularTexCoords.push_back(createArrayOfType(texCoordArray));
-	}
-	vector<ref_ptr<Array> > protectedVertexAttribs;
-	vector<ref_ptr<Array> > regularVertexAttribs;
-	for (auto vertexAttribArray: vertexAttribArrays)
-	{
-		protectedVertexAttribs.push_back(createArrayOfType(vertexAttribArray));
-		regularVertexAttribs.push_back(createArrayOfType(vertexAttribArray));
-	}
+	ArrayGather gather(*geometry);
+
+	// vertex IDs and original vertex IDs are both smaller than the vertex count, so flat arrays replace sets and maps
+	const unsigned int invalidID = UINT_MAX;
+	size_t numVertices = geometry->getVertexArray()->getNumElements();
 
 	// first find protected vertices
-    set<unsigned int> protectedVertexSet;
+    vector<unsigned char> protectedVertexSet(numVertices, 0);
     for (size_t i = 0; i < halfEdges->size(); ++i)
 	{
 		HalfEdge* halfEdge = &halfEdges->at(i);
@@ -313,97 +464,53 @@ void ConvertToLevelOfDetailGeometryVisitor::findAndSortProtectedVertices(ref_ptr
         if (halfEdge->opposite == LLONG_MAX)
 		{
 			// no opposite add this half edge and the next to the set
-			protectedVertexSet.insert(halfEdge->vertexID);
-            protectedVertexSet.insert(nextEdge->vertexID);          
+			protectedVertexSet[halfEdge->vertexID] = 1;
+            protectedVertexSet[nextEdge->vertexID] = 1;
 		}
         else if (prevEdge->opposite == LLONG_MAX)
         {
             // prev half edge has no opposite add this and the previous to the set
-			protectedVertexSet.insert(halfEdge->vertexID);
-            protectedVertexSet.insert(prevEdge->vertexID);
+			protectedVertexSet[halfEdge->vertexID] = 1;
+            protectedVertexSet[prevEdge->vertexID] = 1;
         }
 	}
     
-    map<unsigned int, unsigned int> protectedVertexIDMap;
-   	map<unsigned int, unsigned int> regularVertexIDMap;
+    vector<unsigned int> protectedVertexIDMap(numVertices, invalidID);
+   	vector<unsigned int> regularVertexIDMap(numVertices, invalidID);
+	vector<unsigned int> protectedVertices;
+	vector<unsigned int> regularVertices;
 
 	for (size_t i = 0; i < halfEdges->size(); ++i)
 	{
 		HalfEdge* halfEdge = &halfEdges->at(i);
-		auto protectedIt = protectedVertexIDMap.find(halfEdge->originalVertexID);
-		auto regularIt = regularVertexIDMap.find(halfEdge->originalVertexID);
         
-        if (protectedVertexSet.find(halfEdge->vertexID) != protectedVertexSet.end() &&
-			protectedIt == protectedVertexIDMap.end())
+        if (protectedVertexSet[halfEdge->vertexID] &&
+			protectedVertexIDMap[halfEdge->originalVertexID] == invalidID)
 		{
 			// protected vertex buffer
-            addElementTo(protectedVertices, vertexArray, halfEdge->originalVertexID);
-			addElementTo(protectedNormals, normalArray, halfEdge->originalVertexID);
-			addElementTo(protectedColors, colorArray, halfEdge->originalVertexID);
-			addElementTo(protectedSecondaryColors, secondaryColorArray, halfEdge->originalVertexID);
-			addElementTo(protectedFogCoords, fogCoordArray, halfEdge->originalVertexID);
-			for (size_t j = 0; j < protectedTexCoords.size(); ++j)
-			{
-				addElementTo(protectedTexCoords[j], texCoordArrays[j], halfEdge->originalVertexID);
-			}
-			for (size_t j = 0; j < protectedVertexAttribs.size(); ++j)
-			{
-				addElementTo(protectedVertexAttribs[j], vertexAttribArrays[j], halfEdge->originalVertexID);
-			}
-
-			protectedVertexIDMap[halfEdge->originalVertexID] = protectedVertices->getNumElements()-1;
+			protectedVertexIDMap[halfEdge->originalVertexID] = protectedVertices.size();
+			protectedVertices.push_back(halfEdge->originalVertexID);
 		}
-		else if (regularIt == regularVertexIDMap.end())
+		else if (regularVertexIDMap[halfEdge->originalVertexID] == invalidID)
         {
 			// regular vertex buffer
-			addElementTo(regularVertices, vertexArray, halfEdge->originalVertexID);
-			addElementTo(regularNormals, normalArray, halfEdge->originalVertexID);
-			addElementTo(regularColors, colorArray, halfEdge->originalVertexID);
-			addElementTo(regularSecondaryColors, secondaryColorArray, halfEdge->originalVertexID);
-			addElementTo(regularFogCoords, fogCoordArray, halfEdge->originalVertexID);
-			for (size_t j = 0; j < regularTexCoords.size(); ++j)
-			{
-				addElementTo(regularTexCoords[j], texCoordArrays[j], halfEdge->originalVertexID);
-			}
-			for (size_t j = 0; j < regularVertexAttribs.size(); ++j)
-			{
-				addElementTo(regularVertexAttribs[j], vertexAttribArrays[j], halfEdge->originalVertexID);
-			}
-
-			regularVertexIDMap[halfEdge->originalVertexID] = regularVertices->getNumElements()-1;
+			regularVertexIDMap[halfEdge->originalVertexID] = regularVertices.size();
+			regularVertices.push_back(halfEdge->originalVertexID);
 		}
 	}
     
-	// merge both buckets and replace old vertex array
-	size_t numFixedVertices = protectedVertices->getNumElements();
-	mergeArrays(protectedVertices, regularVertices);
-	mergeArrays(protectedNormals, regularNormals);
-	mergeArrays(protectedColors, regularColors);
-	mergeArrays(protectedSecondaryColors, regularSecondaryColors);
-	mergeArrays(protectedFogCoords, regularFogCoords);
-	for (size_t j = 0; j < regularTexCoords.size(); ++j)
-	{
-		mergeArrays(protectedTexCoords[j], regularTexCoords[j]);
-	}
-	for (size_t j = 0; j < regularVertexAttribs.size(); ++j)
-	{
-		mergeArrays(protectedVertexAttribs[j], regularVertexAttribs[j]);
-	}
-
-	lodGeometry->setVertexArray(protectedVertices);
-    if (normalArray && normalArray->getBinding() == Array::BIND_PER_VERTEX) { lodGeometry->setNormalArray(protectedNormals); }
-    if (colorArray && colorArray->getBinding() == Array::BIND_PER_VERTEX) { lodGeometry->setColorArray(protectedColors); }
-    if (secondaryColorArray && secondaryColorArray->getBinding() == Array::BIND_PER_VERTEX) { lodGeometry->setSecondaryColorArray(protectedSecondaryColors); }
-    if (fogCoordArray && fogCoordArray->getBinding() == Array::BIND_PER_VERTEX) { lodGeometry->setFogCoordArray(protectedFogCoords); }
+	// gather both buckets one after another into the new per vertex arrays
+	size_t numFixedVertices = protectedVertices.size();
+	vector<unsigned int> elements(protectedVertices);
+	elements.insert(elements.end(), regularVertices.begin(), regularVertices.end());
 
-    for (size_t j = 0; j < protectedTexCoords.size(); ++j)
+	vector<ref_ptr<Array> > arrays = gather.gather(elements);
+	for (size_t j = 1; j < arrays.size(); ++j)
 	{
-        if (texCoordArrays[j] && texCoordArrays[j]->getBinding() == Array::BIND_PER_VERTEX) { lodGeometry->setTexCoordArray(j, protectedTexCoords[j]); }
-	}
-	for (size_t j = 0; j < protectedVertexAttribs.size(); ++j)
-	{
-        if (vertexAttribArrays[j] && vertexAttribArrays[j]->getBinding() == Array::BIND_PER_VERTEX) { lodGeometry->setVertexAttribArray(j, protectedVertexAttribs[j]); }
+		// arrays that are not per vertex are dropped
+		if (!gather.isPerVertex(gather.getSourceArrays()[j].get())) { arrays[j] = NULL; }
 	}
+	gather.setArrays(*lodGeometry, arrays);
 
 
     for (size_t i = 0; i < lodGeometry->getNumPrimitiveSets(); ++i)
@@ -413,16 +520,16 @@ void ConvertToLevelOfDetailGeometryVisitor::findAndSortProtectedVertices(ref_ptr
         // translate vertexIDs to new ID
 	    for (size_t j = 0; j < lodDrawElements->size(); ++j)
 	    {
-		    auto protectedIt = protectedVertexIDMap.find(lodDrawElements->at(j));
-		    auto normalIt = regularVertexIDMap.find(lodDrawElements->at(j));
+		    unsigned int protectedID = protectedVertexIDMap[lodDrawElements->at(j)];
+		    unsigned int regularID = regularVertexIDMap[lodDrawElements->at(j)];
 
-		    if (protectedIt != protectedVertexIDMap.end())
+		    if (protectedID != invalidID)
 		    {
-			    lodDrawElements->at(j) = protectedIt->second;
+			    lodDrawElements->at(j) = protectedID;
 		    }
-		    else if (normalIt != regularVertexIDMap.end())
+		    else if (regularID != invalidID)
 		    {
-			    lodDrawElements->at(j) = normalIt->second + numFixedVertices;
+			    lodDrawElements->at(j) = regularID + numFixedVertices;
 		    }
 		    else
 		    {
@@ -437,261 +544,345 @@ void ConvertToLevelOfDetailGeometryVisitor::findAndSortProtectedVertices(ref_ptr
 	lodGeometry->setNumberOfProtectedVertices(numFixedVertices);
 }
 
-ref_ptr<Array> ConvertToLevelOfDetailGeometryVisitor::createArrayOfType(osg::ref_ptr<osg::Array> rhs) const
+void ConvertToLevelOfDetailGeometryVisitor::sortVerticesByLod(ref_ptr<LevelOfDetailGeometry> lodGeometry) const
 {
-	if (rhs == NULL)
-		return NULL;
-
-    ref_ptr<Array> array = NULL;
-	switch (rhs->getType())
-	{
-	case Array::ByteArrayType:
-        array = new ByteArray();
-		break;
-	case Array::ShortArrayType:
-		array = new ShortArray();
-		break;
-	case Array::IntArrayType:
-		array = new IntArray();
-		break;
-	case Array::UByteArrayType:
-		array = new UByteArray();
-		break;
-	case Array::UShortArrayType:
-		array = new UShortArray();
-		break;
-	case Array::UIntArrayType:
-		array = new UIntArray();
-		break;
-	case Array::Vec4ubArrayType:
-		array = new Vec4ubArray();
-		break;
-	case Array::FloatArrayType:
-		array = new FloatArray();
-		break;
-	case Array::Vec2ArrayType:
-		array = new Vec2Array();
-		break;
-	case Array::Vec3ArrayType:
-		array = new Vec3Array();
-		break;
-	case Array::Vec4ArrayType:
-		array = new Vec4Array();
-		break;
-	case Array::Vec2sArrayType:
-		array = new Vec2sArray();
-		break;
-	case Array::Vec3sArrayType:
-		array = new Vec3sArray();
-		break;
-	case Array::Vec4sArrayType:
-		array = new Vec4sArray();
-		break;
-    case Array::Vec2bArrayType:
-		array = new Vec2bArray();
-		break;
-	case Array::Vec3bArrayType:
-		array = new Vec3bArray();
-		break;
-	case Array::Vec4bArrayType:
-		array = new Vec4bArray();
-		break;
-    case Array::DoubleArrayType:
-		array = new DoubleArray();
-		break;
-	case Array::Vec2dArrayType:
-		array = new Vec2dArray();
-		break;
-	case Array::Vec3dArrayType:
-		array = new Vec3dArray();
-		break;
-	case Array::Vec4dArrayType:
-		array = new Vec4dArray();
-		break;  
-	case Array::MatrixArrayType:
-		array = new MatrixfArray();
-		break;
-	}
-
-    array->setBinding(rhs->getBinding());
-    return array;
+	size_t numVertices = lodGeometry->getVertexArray()->getNumElements();
+	size_t numProtectedVertices = lodGeometry->getNumberOfProtectedVertices();
+
+	// find the first lod of every vertex over all primitives
+	vector<unsigned int> firstLod(numVertices, 32);
+	for (size_t i = 0; i < lodGeometry->getNumPrimitiveSets(); ++i)
+	{
+		DrawElements* drawElements = lodGeometry->getPrimitiveSet(i)->getDrawElements();
+		LevelOfDetailDrawElements* lodDrawElements = dynamic_cast<LevelOfDetailDrawElements*>(drawElements);
+		if (!lodDrawElements) { continue; }
+
+		vector<GLint> lodRange = lodDrawElements->getLodRanges();
+		GLint start = 0;
+		for (unsigned int k = 0; k < 32; ++k)
+		{
+			for (GLint j = start; j < lodRange[k]; ++j)
+			{
+				unsigned int& lod = firstLod[drawElements->getElement(j)];
+				lod = std::min(lod, k);
+			}
+			start = lodRange[k];
+		}
+	}
+
+	// counting sort of the regular vertices, unused vertices go to the back, protected vertices keep their place
+	vector<size_t> lodStart(34, numProtectedVertices);
+	for (size_t v = numProtectedVertices; v < numVertices; ++v) { ++lodStart[firstLod[v] + 1]; }
+	for (size_t k = 1; k < lodStart.size(); ++k) { lodStart[k] += lodStart[k-1] - numProtectedVertices; }
+
+	const unsigned int invalidIndex = UINT_MAX;
+	vector<unsigned int> newIndex(numVertices, invalidIndex);
+	for (size_t v = 0; v < numProtectedVertices; ++v) { newIndex[v] = v; }
+
+	// within its lod every vertex gets the place of its first use, so the reordered triangles read the buffer mostly forward
+	if (_optimizeVertexCache)
+	{
+		for (size_t i = 0; i < lodGeometry->getNumPrimitiveSets(); ++i)
+		{
+			DrawElements* drawElements = lodGeometry->getPrimitiveSet(i)->getDrawElements();
+			if (!dynamic_cast<LevelOfDetailDrawElements*>(drawElements)) { continue; }
+
+			for (unsigned int j = 0; j < drawElements->getNumIndices(); ++j)
+			{
+				unsigned int v = drawElements->getElement(j);
+				if (newIndex[v] == invalidIndex) { newIndex[v] = lodStart[firstLod[v]]++; }
+			}
+		}
+	}
+
+	vector<unsigned int> oldIndex(numVertices);
+	for (size_t v = 0; v < numVertices; ++v)
+	{
+		if (newIndex[v] == invalidIndex) { newIndex[v] = lodStart[firstLod[v]]++; }
+		oldIndex[newIndex[v]] = v;
+	}
+
+	// reorder all per vertex arrays
+	ArrayGather gather(*lodGeometry);
+	gather.setArrays(*lodGeometry, gather.gather(oldIndex));
+
+	// remap indices and record the vertex range of every lod
+	for (size_t i = 0; i < lodGeometry->getNumPrimitiveSets(); ++i)
+	{
+		DrawElements* drawElements = lodGeometry->getPrimitiveSet(i)->getDrawElements();
+		LevelOfDetailDrawElements* lodDrawElements = dynamic_cast<LevelOfDetailDrawElements*>(drawElements);
+		if (!lodDrawElements) { continue; }
+
+		vector<GLint> lodRange = lodDrawElements->getLodRanges();
+		vector<GLint> vertexRange(32);
+		GLint start = 0;
+		GLint vertexEnd = numProtectedVertices;
+		for (unsigned int k = 0; k < 32; ++k)
+		{
+			for (GLint j = start; j < lodRange[k]; ++j)
+			{
+				unsigned int index = newIndex[drawElements->getElement(j)];
+				drawElements->setElement(j, index);
+				vertexEnd = std::max(vertexEnd, GLint(index + 1));
+			}
+			vertexRange[k] = vertexEnd;
+			start = lodRange[k];
+		}
+
+		lodDrawElements->setVertexRanges(vertexRange);
+		lodDrawElements->setLod(31);
+	}
+}
+
+template<class VertexArray> void _measureLodErrors(ref_ptr<LevelOfDetailGeometry> lodGeometry, size_t numUsedVertices, vector<float>* lodErrors)
+{
+	const VertexArray* vertices = dynamic_cast<const VertexArray*>(lodGeometry->getVertexArray());
+	const Vec3& min = lodGeometry->getMinBounds();
+	const Vec3& max = lodGeometry->getMaxBounds();
+
+	for (int k = 0; k < 32; ++k)
+	{
+		// lod k is drawn with k+1 bits, protected vertices are not quantized and have no error
+		Vec3 quantizationFactors = quantizationFactor(k + 1, min, max);
+		Vec3 dequantizationFactors = dequantizationFactor(k + 1, min, max);
+		float maxError = 0.0f;
+		for (size_t v = lodGeometry->getNumberOfProtectedVertices(); v < numUsedVertices; ++v)
+		{
+			Vec3 vertex((*vertices)[v].x(), (*vertices)[v].y(), (*vertices)[v].z());
+			Vec3 quantizedVertex = dequantize<Vec3>(dequantizationFactors, min, quantize(quantizationFactors, min, vertex));
+			maxError = std::max(maxError, (quantizedVertex - vertex).length());
+		}
+		(*lodErrors)[k] = maxError;
+	}
+}
+
+void ConvertToLevelOfDetailGeometryVisitor::measureLodErrors(ref_ptr<LevelOfDetailGeometry> lodGeometry) const
+{
+	// triangles collapsed in a lod lie within the error of their vertices, so measuring the displacement of every used
+	// vertex bounds the distance of the whole mesh to the lod. Vertices are sorted by lod, unused ones are at the back.
+	size_t numUsedVertices = lodGeometry->getNumberOfProtectedVertices();
+	for (size_t i = 0; i < lodGeometry->getNumPrimitiveSets(); ++i)
+	{
+		LevelOfDetailDrawElements* lodDrawElements = dynamic_cast<LevelOfDetailDrawElements*>(lodGeometry->getPrimitiveSet(i));
+		if (!lodDrawElements || lodDrawElements->getVertexRanges().empty()) { continue; }
+
+		numUsedVertices = std::max(numUsedVertices, size_t(lodDrawElements->getVertexRanges().back()));
+	}
+
+	vector<float> lodErrors(32, 0.0f);
+	switch(lodGeometry->getVertexArray()->getType())
+	{
+		case Array::Vec3ArrayType:
+		{
+			_measureLodErrors<Vec3Array>(lodGeometry, numUsedVertices, &lodErrors);
+		} break;
+		case Array::Vec3dArrayType:
+		{
+			_measureLodErrors<Vec3dArray>(lodGeometry, numUsedVertices, &lodErrors);
+		} break;
+		case Array::Vec3bArrayType:
+		{
+			_measureLodErrors<Vec3bArray>(lodGeometry, numUsedVertices, &lodErrors);
+		} break;
+		case Array::Vec3sArrayType:
+		{
+			_measureLodErrors<Vec3sArray>(lodGeometry, numUsedVertices, &lodErrors);
+		} break;
+		default:
+			// unknown vertex format
+			return;
+	}
+
+	// the grids of neighbouring lods are not nested, keep the errors decreasing so finer lods never look worse
+	for (int k = 30; k >= 0; --k) { lodErrors[k] = std::max(lodErrors[k], lodErrors[k+1]); }
+
+	lodGeometry->setLodErrors(lodErrors);
+}
+
+/**
+ @brief converts a float to the bits of a half float, rounded to nearest
+*/
+static unsigned short floatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	unsigned short sign = (bits >> 16) & 0x8000u;
+	int exponent = int((bits >> 23) & 0xFFu) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFFu;
+
+	// too large values and NaNs become infinite, too small ones zero
+	if (exponent >= 31) { return sign | 0x7C00u; }
+	if (exponent < -10) { return sign; }
+	if (exponent <= 0)
+	{
+		// denormalized half, the implicit leading one becomes part of the mantissa
+		mantissa |= 0x800000u;
+		int shift = 14 - exponent;
+		return sign | ((mantissa + (1u << (shift - 1))) >> shift);
+	}
+
+	// a carry of the rounding into the exponent gives the right result
+	return (sign | (exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1u);
 }
 
+/**
+ @brief maps a normal onto the octahedron and unfolds its lower half, both coordinates as normalized shorts
+*/
+static Vec2s encodeOctahedral(const Vec3& normal)
+{
+	float length = std::abs(normal.x()) + std::abs(normal.y()) + std::abs(normal.z());
+	if (length == 0.0f) { return Vec2s(0, 0); }
 
-template<class ArrayType> void _addElementTo(osg::ref_ptr<osg::Array> dst, osg::ref_ptr<osg::Array> src, size_t element)
+	float x = normal.x() / length;
+	float y = normal.y() / length;
+	if (normal.z() < 0.0f)
+	{
+		float foldedX = (1.0f - std::abs(y)) * ((x >= 0.0f) ? 1.0f : -1.0f);
+		y = (1.0f - std::abs(x)) * ((y >= 0.0f) ? 1.0f : -1.0f);
+		x = foldedX;
+	}
+
+	return Vec2s(short(floorf(std::max(-1.0f, std::min(x, 1.0f)) * 32767.0f + 0.5f)),
+	             short(floorf(std::max(-1.0f, std::min(y, 1.0f)) * 32767.0f + 0.5f)));
+}
+
+/**
+ @brief the local grid index of every axis of a position, 0 to 65535 from the offset of the geometry on
+*/
+static int compressionIndex(float position, float origin, float step, int offset)
+{
+	float index = floorf((position - origin) / step + 0.5f) - float(offset);
+	return int(std::max(0.0f, std::min(index, 65535.0f)));
+}
+
+template<class VertexArray> BoundingBox _snapToCompressionGrid(VertexArray& vertices, const Vec3& origin, const Vec3& step, const int offset[3])
 {
-	// cast the arrays to the right type
-	ArrayType* source = dynamic_cast<ArrayType*>(src.get());
-	ArrayType* destination = dynamic_cast<ArrayType*>(dst.get());
+	// the same float arithmetic as LevelOfDetailGeometry::decodeVertex()
+	BoundingBox bounds;
+	for (auto& vertex: vertices)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			int index = compressionIndex(float(vertex[i]), origin[i], step[i], offset[i]);
+			vertex[i] = origin[i] + float(index + offset[i]) * step[i];
+		}
+		bounds.expandBy(Vec3(vertex.x(), vertex.y(), vertex.z()));
+	}
 
-	destination->push_back(source->at(element));
+	return bounds;
 }
 
-void ConvertToLevelOfDetailGeometryVisitor::addElementTo(osg::ref_ptr<osg::Array> dst, osg::ref_ptr<osg::Array> src, size_t element) const
+void ConvertToLevelOfDetailGeometryVisitor::snapToCompressionGrid(ref_ptr<LevelOfDetailGeometry> lodGeometry) const
 {
-	// assert that we have an source and destination array, that they have the same type, that we access an existing element, and that the binding type is bind per vertex
-	if (!dst || ! src) { return; }
-	if (dst->getType() != src->getType()) { return; }
-	if (element >= src->getNumElements()) { return; }
-    if (dst->getBinding() != Array::BIND_PER_VERTEX) { return; }
-
-	switch(src->getType())
-	{
-	case Array::ByteArrayType:
-		_addElementTo<ByteArray>(dst, src, element);
-		break;
-	case Array::ShortArrayType:
-		_addElementTo<ShortArray>(dst, src, element);
-		break;
-	case Array::IntArrayType:
-		_addElementTo<IntArray>(dst, src, element);
-		break;
-	case Array::UByteArrayType:
-		_addElementTo<UByteArray>(dst, src, element);
-		break;
-	case Array::UShortArrayType:
-		_addElementTo<UShortArray>(dst, src, element);
-		break;
-	case Array::UIntArrayType:
-		_addElementTo<UIntArray>(dst, src, element);
-		break;
-	case Array::Vec4ubArrayType:
-		_addElementTo<Vec4ubArray>(dst, src, element);
-		break;
-	case Array::FloatArrayType:
-		_addElementTo<FloatArray>(dst, src, element);
-		break;
-	case Array::Vec2ArrayType:
-		_addElementTo<Vec2Array>(dst, src, element);
-		break;
-	case Array::Vec3ArrayType:
-		_addElementTo<Vec3Array>(dst, src, element);
-		break;
-	case Array::Vec4ArrayType:
-		_addElementTo<Vec4Array>(dst, src, element);
-		break;
-	case Array::Vec2sArrayType:
-		_addElementTo<Vec2sArray>(dst, src, element);
-		break;
-	case Array::Vec3sArrayType:
-		_addElementTo<Vec3sArray>(dst, src, element);
-		break;
-	case Array::Vec4sArrayType:
-		_addElementTo<Vec4sArray>(dst, src, element);
-		break;
-    case Array::Vec2bArrayType:
-		_addElementTo<Vec2bArray>(dst, src, element);
-		break;
-	case Array::Vec3bArrayType:
-		_addElementTo<Vec3bArray>(dst, src, element);
-		break;
-	case Array::Vec4bArrayType:
-		_addElementTo<Vec4bArray>(dst, src, element);
-		break;
-    case Array::DoubleArrayType:
-		_addElementTo<DoubleArray>(dst, src, element);
-		break;
-	case Array::Vec2dArrayType:
-		_addElementTo<Vec2dArray>(dst, src, element);
-		break;
-	case Array::Vec3dArrayType:
-		_addElementTo<Vec3dArray>(dst, src, element);
-		break;
-	case Array::Vec4dArrayType:
-		_addElementTo<Vec4dArray>(dst, src, element);
-		break;  
-	case Array::MatrixArrayType:
-		_addElementTo<MatrixfArray>(dst, src, element);
-		break;
+	// geometries without a shared grid are compressed within their own bounds
+	const Vec3& min = lodGeometry->getMinBounds();
+	Vec3 origin = _hasCompressionGrid ? _compressionOrigin : min;
+	Vec3 step = _hasCompressionGrid ? _compressionStep : compressionStep(lodGeometry->getMaxBounds() - min, Vec3(0.0f, 0.0f, 0.0f));
+	int offset[3];
+	for (int i = 0; i < 3; ++i) { offset[i] = int(floorf((min[i] - origin[i]) / step[i])); }
+
+	BoundingBox bounds;
+	switch(lodGeometry->getVertexArray()->getType())
+	{
+		case Array::Vec3ArrayType:
+		{
+			bounds = _snapToCompressionGrid(*static_cast<Vec3Array*>(lodGeometry->getVertexArray()), origin, step, offset);
+		} break;
+		case Array::Vec3dArrayType:
+		{
+			bounds = _snapToCompressionGrid(*static_cast<Vec3dArray*>(lodGeometry->getVertexArray()), origin, step, offset);
+		} break;
+		default:
+			// integer vertices are not compressed
+			return;
 	}
+
+	// snapped vertices may leave the bounds by half a step, the lods have to quantize within them
+	lodGeometry->setCompressionGrid(origin, step, offset);
+	setQuantizationBounds(lodGeometry, bounds);
 }
 
-template<class ArrayType> void _mergeArrays(osg::ref_ptr<osg::Array> first, osg::ref_ptr<osg::Array> second)
+template<class VertexArray> ref_ptr<Vec3sArray> _compressVertices(const VertexArray& vertices, const LevelOfDetailGeometry& lodGeometry)
 {
-	ArrayType* _first = dynamic_cast<ArrayType*>(first.get());
-	ArrayType* _second = dynamic_cast<ArrayType*>(second.get());
+	// the vertices lie on the grid already, local grid indices are shifted into the range of signed shorts that glVertexPointer accepts
+	const Vec3& origin = lodGeometry.getCompressionOrigin();
+	const Vec3& step = lodGeometry.getCompressionStep();
+	ref_ptr<Vec3sArray> compressedVertices = new Vec3sArray(vertices.size());
+	for (size_t v = 0; v < vertices.size(); ++v)
+	{
+		Vec3s& compressedVertex = (*compressedVertices)[v];
+		for (int i = 0; i < 3; ++i)
+		{
+			compressedVertex[i] = short(compressionIndex(float(vertices[v][i]), origin[i], step[i], lodGeometry.getCompressionOffset(i)) - 32768);
+		}
+	}
 
-	_first->reserve(_first->size() + _second->size());
-	_first->insert(_first->end(), _second->begin(), _second->end());
-	_first->dirty();
+	return compressedVertices;
 }
 
-void ConvertToLevelOfDetailGeometryVisitor::mergeArrays(osg::ref_ptr<osg::Array> first, osg::ref_ptr<osg::Array> second) const
+void ConvertToLevelOfDetailGeometryVisitor::compressAttributes(ref_ptr<LevelOfDetailGeometry> lodGeometry) const
 {
-	// assert that we have an source and destination array, and that they have the same type
-	if (!first || ! second) { return; }
-	if (first->getType() != second->getType()) { return; }
-    if (first->getBinding() != Array::BIND_PER_VERTEX) { return; }
-
-	switch(first->getType())
-	{
-	case Array::ByteArrayType:
-		_mergeArrays<ByteArray>(first, second);
-		break;
-	case Array::ShortArrayType:
-		_mergeArrays<ShortArray>(first, second);
-		break;
-	case Array::IntArrayType:
-		_mergeArrays<IntArray>(first, second);
-		break;
-	case Array::UByteArrayType:
-		_mergeArrays<UByteArray>(first, second);
-		break;
-	case Array::UShortArrayType:
-		_mergeArrays<UShortArray>(first, second);
-		break;
-	case Array::UIntArrayType:
-		_mergeArrays<UIntArray>(first, second);
-		break;
-	case Array::Vec4ubArrayType:
-		_mergeArrays<Vec4ubArray>(first, second);
-		break;
-	case Array::FloatArrayType:
-		_mergeArrays<FloatArray>(first, second);
-		break;
-	case Array::Vec2ArrayType:
-		_mergeArrays<Vec2Array>(first, second);
-		break;
-	case Array::Vec3ArrayType:
-		_mergeArrays<Vec3Array>(first, second);
-		break;
-	case Array::Vec4ArrayType:
-		_mergeArrays<Vec4Array>(first, second);
-		break;
-	case Array::Vec2sArrayType:
-		_mergeArrays<Vec2sArray>(first, second);
-		break;
-	case Array::Vec3sArrayType:
-		_mergeArrays<Vec3sArray>(first, second);
-		break;
-	case Array::Vec4sArrayType:
-		_mergeArrays<Vec4sArray>(first, second);
-		break;
-    case Array::Vec2bArrayType:
-		_mergeArrays<Vec2bArray>(first, second);
-		break;
-	case Array::Vec3bArrayType:
-		_mergeArrays<Vec3bArray>(first, second);
-		break;
-	case Array::Vec4bArrayType:
-		_mergeArrays<Vec4bArray>(first, second);
-		break;
-    case Array::DoubleArrayType:
-		_mergeArrays<DoubleArray>(first, second);
-		break;
-	case Array::Vec2dArrayType:
-		_mergeArrays<Vec2dArray>(first, second);
-		break;
-	case Array::Vec3dArrayType:
-		_mergeArrays<Vec3dArray>(first, second);
-		break;
-	case Array::Vec4dArrayType:
-		_mergeArrays<Vec4dArray>(first, second);
-		break;  
-	case Array::MatrixArrayType:
-		_mergeArrays<MatrixfArray>(first, second);
-		break;
+	size_t numVertices = lodGeometry->getVertexArray()->getNumElements();
+	int compressedAttributes = 0;
+
+	ref_ptr<Vec3sArray> compressedVertices;
+	switch(lodGeometry->getVertexArray()->getType())
+	{
+		case Array::Vec3ArrayType:
+		{
+			compressedVertices = _compressVertices(*static_cast<Vec3Array*>(lodGeometry->getVertexArray()), *lodGeometry);
+		} break;
+		case Array::Vec3dArrayType:
+		{
+			compressedVertices = _compressVertices(*static_cast<Vec3dArray*>(lodGeometry->getVertexArray()), *lodGeometry);
+		} break;
+		default:
+			// integer vertices are small already
+			break;
 	}
+	if (compressedVertices)
+	{
+		lodGeometry->setVertexArray(compressedVertices);
+		compressedAttributes |= LevelOfDetailGeometry::COMPRESSED_VERTICES;
+
+		// the lod errors are measured from the snapped vertices, which are up to half a step away from the original ones
+		float compressionError = 0.5f * lodGeometry->getCompressionStep().length();
+		vector<float> lodErrors = lodGeometry->getLodErrors();
+		for (auto& lodError: lodErrors) { lodError = std::max(lodError, compressionError); }
+		lodGeometry->setLodErrors(lodErrors);
+	}
+
+	// normals and texture coordinates move to the vertex attributes the shader prelude decodes
+	const Vec3Array* normals = dynamic_cast<const Vec3Array*>(lodGeometry->getNormalArray());
+	if (normals && normals->getBinding() == Array::BIND_PER_VERTEX && normals->size() == numVertices &&
+	    !lodGeometry->getVertexAttribArray(LevelOfDetailGeometry::PACKED_NORMAL_ATTRIBUTE))
+	{
+		ref_ptr<Vec2sArray> packedNormals = new Vec2sArray(numVertices);
+		for (size_t v = 0; v < numVertices; ++v) { (*packedNormals)[v] = encodeOctahedral((*normals)[v]); }
+		packedNormals->setNormalize(true);
+
+		lodGeometry->setNormalArray(NULL);
+		lodGeometry->setVertexAttribArray(LevelOfDetailGeometry::PACKED_NORMAL_ATTRIBUTE, packedNormals, Array::BIND_PER_VERTEX);
+		compressedAttributes |= LevelOfDetailGeometry::COMPRESSED_NORMALS;
+	}
+
+	const Vec2Array* texCoords = dynamic_cast<const Vec2Array*>(lodGeometry->getTexCoordArray(0));
+	if (texCoords && texCoords->getBinding() == Array::BIND_PER_VERTEX && texCoords->size() == numVertices &&
+	    !lodGeometry->getVertexAttribArray(LevelOfDetailGeometry::PACKED_TEXCOORD_ATTRIBUTE))
+	{
+		ref_ptr<Vec2usArray> packedTexCoords = new Vec2usArray(numVertices);
+		for (size_t v = 0; v < numVertices; ++v)
+		{
+			(*packedTexCoords)[v] = Vec2us(floatToHalf((*texCoords)[v].x()), floatToHalf((*texCoords)[v].y()));
+		}
+		packedTexCoords->setNormalize(false);
+
+		lodGeometry->setTexCoordArray(0, NULL);
+		lodGeometry->setVertexAttribArray(LevelOfDetailGeometry::PACKED_TEXCOORD_ATTRIBUTE, packedTexCoords, Array::BIND_PER_VERTEX);
+		compressedAttributes |= LevelOfDetailGeometry::COMPRESSED_TEXCOORDS;
+	}
+
+	lodGeometry->setCompressedAttributes(compressedAttributes);
 }
 
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include <osg/Array>
 #include <osg/Geode>
@@ -18,24 +19,70 @@ class OSG_EXPORT ConvertToLevelOfDetailGeometryVisitor : public osg::NodeVisitor
 public:
 	ConvertToLevelOfDetailGeometryVisitor()
 		: osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN)
+		, _optimizeVertexCache(true)
+		, _compressAttributes(false)
+		, _hasCompressionGrid(false)
+		, _collectGeodes(false)
 	{
 	}
 
 	virtual void apply(osg::Geode& geode);
-protected:
+
+	/**
+	 @brief converts all geometries below node on numThreads threads, 0 uses one thread per core.
+	 The resulting scene graph is identical to the one of the serial traversal. With compressed attributes
+	 the compression grid is computed from node first.
+	*/
+	void convertParallel(osg::Node& node, unsigned int numThreads=0);
+
+	/**
+	 @brief converts a single geometry, returns NULL if the vertex format is not supported
+	*/
 	osg::ref_ptr<osg::LevelOfDetailGeometry> convert(osg::ref_ptr<osg::Geometry> geometry) const;
+
+	/**
+	 @brief reorders the triangles of every lod for the post transform vertex cache and the vertices of every lod by
+	 their first use. Each lod is reordered on its own, so every lod stays a prefix of the finer ones. On by default.
+	*/
+	inline void setOptimizeVertexCache(bool optimizeVertexCache) { _optimizeVertexCache = optimizeVertexCache; }
+	inline bool getOptimizeVertexCache() const { return _optimizeVertexCache; }
+
+	/**
+	 @brief stores vertices as 16 bit integers on the compression grid, normals as octahedral 2x16 bit and the first
+	 texture coordinates as half floats, see osg::LevelOfDetailGeometry::setCompressedAttributes(). Off by default.
+	*/
+	inline void setCompressAttributes(bool compressAttributes) { _compressAttributes = compressAttributes; }
+	inline bool getCompressAttributes() const { return _compressAttributes; }
+
+	/**
+	 @brief computes one grid for the compressed vertices of all geometries below node. Call it before converting
+	 the geometries of a scene one by one, so the shared vertices of neighbouring geometries, like the chunks of a kd tree,
+	 decode to the same position. Without a grid every geometry is compressed on a grid of its own bounds.
+	*/
+	void computeCompressionGrid(osg::Node& node);
+	inline void clearCompressionGrid() { _hasCompressionGrid = false; }
+protected:
     bool collectHalfEdges(osg::ref_ptr<osg::Geometry> geometry,
                           osg::ref_ptr<osg::LevelOfDetailGeometry>  lodGeometry,
                           std::vector<HalfEdge>*      halfEdges) const;
 	bool collectLod(osg::ref_ptr<osg::Geometry> geometry,
-                    float min,
-                    float max,
+                    const osg::Vec3& min,
+                    const osg::Vec3& max,
                     int numProtectedVertices) const;
 	void findHalfEdgeOpposite(std::vector<HalfEdge>* halfEdges) const;
     void findAndSortProtectedVertices(osg::ref_ptr<osg::Geometry> geometry, osg::ref_ptr<osg::LevelOfDetailGeometry> lodGeometry, std::vector<HalfEdge>* halfEdges) const;
-	osg::ref_ptr<osg::Array> createArrayOfType(osg::ref_ptr<osg::Array> rhs) const;
-	void addElementTo(osg::ref_ptr<osg::Array> dst, osg::ref_ptr<osg::Array> src, size_t element) const;
-	void mergeArrays(osg::ref_ptr<osg::Array> first, osg::ref_ptr<osg::Array> second) const;
+	void sortVerticesByLod(osg::ref_ptr<osg::LevelOfDetailGeometry> lodGeometry) const;
+	void measureLodErrors(osg::ref_ptr<osg::LevelOfDetailGeometry> lodGeometry) const;
+	void snapToCompressionGrid(osg::ref_ptr<osg::LevelOfDetailGeometry> lodGeometry) const;
+	void compressAttributes(osg::ref_ptr<osg::LevelOfDetailGeometry> lodGeometry) const;
+
+	bool _optimizeVertexCache;
+	bool _compressAttributes;
+	bool _hasCompressionGrid;
+	osg::Vec3 _compressionOrigin;
+	osg::Vec3 _compressionStep;
+	bool _collectGeodes;
+	std::vector<osg::ref_ptr<osg::Geode> > _geodes;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,38 @@
+#include "GLFunctions.h"
+
+#include <osg/GLExtensions>
+#include <osg/buffered_value>
+#include <osg/ref_ptr>
+
+#ifndef GL_MAX_TEXTURE_BUFFER_SIZE
+#define GL_MAX_TEXTURE_BUFFER_SIZE 0x8C2B
+#endif
+
+using namespace osg;
+
+namespace osg
+{
+
+GLFunctions::GLFunctions()
+	: glDrawRangeElementsProc(NULL)
+	, glMultiDrawElementsProc(NULL)
+	, maxTextureBufferSize(0)
+{
+	setGLExtensionFuncPtr(glDrawRangeElementsProc, "glDrawRangeElements", "glDrawRangeElementsEXT");
+	setGLExtensionFuncPtr(glMultiDrawElementsProc, "glMultiDrawElements", "glMultiDrawElementsEXT");
+
+	// contexts without texture buffers leave the value untouched and report an error
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTextureBufferSize);
+	while (glGetError() != GL_NO_ERROR) {}
+}
+
+const GLFunctions* GLFunctions::getFunctions(unsigned int contextID)
+{
+	// every context only touches its own slot from its own draw thread
+	static buffered_value<ref_ptr<GLFunctions> > s_functions;
+	if (!s_functions[contextID]) { s_functions[contextID] = new GLFunctions(); }
+
+	return s_functions[contextID].get();
+}
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <osg/GL>
+#include <osg/Referenced>
+#include <osg/Export>
+
+namespace osg
+{
+
+/**
+ @brief GL entry points that not every GL library exports and limits of the context. They are queried once per context,
+ from the draw thread of the context while it is current. Entry points are NULL if the context doesn't provide them.
+*/
+class OSG_EXPORT GLFunctions : public osg::Referenced
+{
+public:
+	typedef void (GL_APIENTRY * DrawRangeElementsProc)(GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const GLvoid* indices);
+	typedef void (GL_APIENTRY * MultiDrawElementsProc)(GLenum mode, const GLsizei* count, GLenum type, const GLvoid* const* indices, GLsizei drawcount);
+
+	/** @brief the entry points of the context, loaded by its first draw */
+	static const GLFunctions* getFunctions(unsigned int contextID);
+
+	DrawRangeElementsProc glDrawRangeElementsProc;
+	MultiDrawElementsProc glMultiDrawElementsProc;
+
+	/** @brief GL_MAX_TEXTURE_BUFFER_SIZE in texels, 0 without texture buffers */
+	GLint maxTextureBufferSize;
+protected:
+	GLFunctions();
+	virtual ~GLFunctions() {}
+};
+
+}
@@ -1,11 +1,11 @@
 #pragma once
 
 #include "Vec3ui.h"
+#include "HashMap.h"
 
 // std
 #include <memory>
 #include <vector>
-#include <map>
 
 // osg
 #include <osg/ref_ptr>
@@ -41,7 +41,7 @@ struct HalfEdge
 template<class VertexArray, class Vector> struct HalfEdgeTriangleCollector
 {
 	osg::ref_ptr<VertexArray>				_vertexArray;
-	std::map<Vector, unsigned int>          _vertexIDMap;
+	HashMap<Vector, unsigned int, VectorHash<Vector> > _vertexIDMap;
 	unsigned int                            _vertexIDCounter;
 	std::vector<HalfEdge>*                  _halfEdges;
     osg::ref_ptr<osg::DrawElementsUInt>     _drawElements;
@@ -64,18 +64,18 @@ template<class VertexArray, class Vector> struct HalfEdgeTriangleCollector
 				return;
 			}
 			
-			// try to find vertices in ID map
-			auto it = _vertexIDMap.find(_vertexArray->at(pos1));
-			if (it == _vertexIDMap.end()) { _vertexIDMap[_vertexArray->at(pos1)] = _vertexIDCounter++; }
-			it = _vertexIDMap.find(_vertexArray->at(pos2));
-			if (it == _vertexIDMap.end()) { _vertexIDMap[_vertexArray->at(pos2)] = _vertexIDCounter++; }
-			it = _vertexIDMap.find(_vertexArray->at(pos3));
-			if (it == _vertexIDMap.end()) { _vertexIDMap[_vertexArray->at(pos3)] = _vertexIDCounter++; }
+			// weld vertices with equal positions, new positions get the next free ID
+			unsigned int vertexID1 = *_vertexIDMap.insert(_vertexArray->at(pos1), _vertexIDCounter).first;
+			if (vertexID1 == _vertexIDCounter) { ++_vertexIDCounter; }
+			unsigned int vertexID2 = *_vertexIDMap.insert(_vertexArray->at(pos2), _vertexIDCounter).first;
+			if (vertexID2 == _vertexIDCounter) { ++_vertexIDCounter; }
+			unsigned int vertexID3 = *_vertexIDMap.insert(_vertexArray->at(pos3), _vertexIDCounter).first;
+			if (vertexID3 == _vertexIDCounter) { ++_vertexIDCounter; }
 
 			// add half edges of the triangle
-			_halfEdges->push_back(HalfEdge(_vertexIDMap[_vertexArray->at(pos1)], pos1));
-			_halfEdges->push_back(HalfEdge(_vertexIDMap[_vertexArray->at(pos2)], pos2));
-			_halfEdges->push_back(HalfEdge(_vertexIDMap[_vertexArray->at(pos3)], pos3));
+			_halfEdges->push_back(HalfEdge(vertexID1, pos1));
+			_halfEdges->push_back(HalfEdge(vertexID2, pos2));
+			_halfEdges->push_back(HalfEdge(vertexID3, pos3));
 			size_t lastIndex = _halfEdges->size() - 1;
 			_halfEdges->at(lastIndex-2).next = lastIndex-1;
 			_halfEdges->at(lastIndex-2).prev = lastIndex;
@@ -91,20 +91,47 @@ template<class VertexArray, class Vector> struct HalfEdgeTriangleCollector
     }
 };
 
+/**
+ TriangleCollector template to sort triangles into the lod where they don't collapse anymore.
+ Triangles are buffered and processed in batches, call flush() after the last triangle.
+*/
 template<class VertexArray, class Vector> struct LodTriangleCollector
 {
+    enum { BATCH_SIZE = 1024 };
+
     osg::ref_ptr<VertexArray>							_vertexArray;
 	std::vector<osg::ref_ptr<osg::DrawElementsUInt> >*  _lodDrawElements;
-	float _min;
-	float _max;
+	osg::Vec3 _min;
+	osg::Vec3 _max;
     unsigned int _numProtectedVertices;
+    osg::Vec3 _quantizationFactors[32];
+    osg::Vec3 _dequantizationFactors[32];
+    std::vector<unsigned int> _batch;
+    std::vector<unsigned int> _activeTriangles;
+    std::vector<unsigned int> _lods;
 
     LodTriangleCollector()
         : _vertexArray(NULL)
 		, _lodDrawElements(NULL)
         , _numProtectedVertices(0)
-    {		
+    {
+        setBounds(osg::Vec3(0.0f, 0.0f, 0.0f), osg::Vec3(1.0f, 1.0f, 1.0f));
 	}
+
+    /**
+     @brief sets the quantization bounds of every axis and precomputes the factors of all lods
+    */
+    void setBounds(const osg::Vec3& min, const osg::Vec3& max)
+    {
+        _min = min;
+        _max = max;
+
+        for (int k = 1; k <= 32; ++k)
+        {
+            _quantizationFactors[k-1] = quantizationFactor(k, _min, _max);
+            _dequantizationFactors[k-1] = dequantizationFactor(k, _min, _max);
+        }
+    }
 	                    
     void operator()(unsigned int pos1, unsigned int pos2, unsigned int pos3)
     {
@@ -115,36 +142,88 @@ template<class VertexArray, class Vector> struct LodTriangleCollector
 			{
 				return;
 			}
-                      
-			
-			// quantize vertices with different precisions to determine the lod, where triangles don't collapse
-			for (int k = 1; k <= 32; ++k)
-			{
-				float precision = pow(2.0f, k);
-				Vector vertices[3] = { _vertexArray->at(pos1),
-									   _vertexArray->at(pos2),
-									   _vertexArray->at(pos3) };
-
-				Vec3ui qVertices[3] = {   quantize(k, _min, _max, vertices[0]),
-									      quantize(k, _min, _max, vertices[1]),
-										  quantize(k, _min, _max, vertices[2]) };
-
-                Vector newVertices[3] = { (pos1 < _numProtectedVertices) ?  vertices[0] : dequantize<Vector>(k, _min, _max, qVertices[0]),
-                                          (pos2 < _numProtectedVertices) ?  vertices[1] : dequantize<Vector>(k, _min, _max, qVertices[1]),
-                                          (pos3 < _numProtectedVertices) ?  vertices[2] : dequantize<Vector>(k, _min, _max, qVertices[2]) };
-
-				if ((newVertices[0] != newVertices[1] &&
-					newVertices[0] != newVertices[2] &&
-					newVertices[1] != newVertices[2]) ||
-                    k == 32)
-				{
-					(*_lodDrawElements)[int(k-1)]->push_back(pos1);
-					(*_lodDrawElements)[int(k-1)]->push_back(pos2);
-					(*_lodDrawElements)[int(k-1)]->push_back(pos3);
-
-					break;
-				}
-			}
+
+            _batch.push_back(pos1);
+            _batch.push_back(pos2);
+            _batch.push_back(pos3);
+
+            if (_batch.size() >= 3 * BATCH_SIZE) { flush(); }
+    }
+
+    /**
+     @brief finds the lod of all buffered triangles and adds them to the lod draw elements in their original order
+    */
+    void flush()
+    {
+        size_t numTriangles = _batch.size() / 3;
+
+        // every triangle is in the finest lod if it collapses in all others
+        _lods.assign(numTriangles, 31);
+        _activeTriangles.resize(numTriangles);
+        for (size_t i = 0; i < numTriangles; ++i) { _activeTriangles[i] = i; }
+
+        // test the whole batch level by level and drop triangles as soon as they survive the quantization
+        for (int k = 1; k < 32 && !_activeTriangles.empty(); ++k)
+        {
+            size_t numActive = 0;
+            for (size_t i = 0; i < _activeTriangles.size(); ++i)
+            {
+                unsigned int triangle = _activeTriangles[i];
+
+                if (survivesQuantization(k, &_batch[3 * triangle]))
+                {
+                    _lods[triangle] = k-1;
+                } else {
+                    _activeTriangles[numActive++] = triangle;
+                }
+            }
+            _activeTriangles.resize(numActive);
+        }
+
+        for (size_t i = 0; i < numTriangles; ++i)
+        {
+            (*_lodDrawElements)[_lods[i]]->push_back(_batch[3 * i]);
+            (*_lodDrawElements)[_lods[i]]->push_back(_batch[3 * i + 1]);
+            (*_lodDrawElements)[_lods[i]]->push_back(_batch[3 * i + 2]);
+        }
+
+        _batch.clear();
+    }
+
+    /**
+     @brief tests if a triangle is not degenerated after quantizing its vertices with k bits
+    */
+    bool survivesQuantization(int k, const unsigned int* pos) const
+    {
+        Vector vertices[3] = { _vertexArray->at(pos[0]),
+                               _vertexArray->at(pos[1]),
+                               _vertexArray->at(pos[2]) };
+        bool protectedVertices[3] = { pos[0] < _numProtectedVertices,
+                                      pos[1] < _numProtectedVertices,
+                                      pos[2] < _numProtectedVertices };
+
+        const osg::Vec3& factor = _quantizationFactors[k-1];
+        Vec3ui qVertices[3] = { quantize(factor, _min, vertices[0]),
+                                quantize(factor, _min, vertices[1]),
+                                quantize(factor, _min, vertices[2]) };
+
+        // two regular vertices in the same cell collapse, which rejects most triangles without dequantizing
+        if ((!protectedVertices[0] && !protectedVertices[1] && qVertices[0] == qVertices[1]) ||
+            (!protectedVertices[0] && !protectedVertices[2] && qVertices[0] == qVertices[2]) ||
+            (!protectedVertices[1] && !protectedVertices[2] && qVertices[1] == qVertices[2]))
+        {
+            return false;
+        }
+
+        // compare the positions the vertex shader will compute
+        const osg::Vec3& invFactor = _dequantizationFactors[k-1];
+        Vector newVertices[3] = { protectedVertices[0] ? vertices[0] : dequantize<Vector>(invFactor, _min, qVertices[0]),
+                                  protectedVertices[1] ? vertices[1] : dequantize<Vector>(invFactor, _min, qVertices[1]),
+                                  protectedVertices[2] ? vertices[2] : dequantize<Vector>(invFactor, _min, qVertices[2]) };
+
+        return newVertices[0] != newVertices[1] &&
+               newVertices[0] != newVertices[2] &&
+               newVertices[1] != newVertices[2];
     }
 };
 
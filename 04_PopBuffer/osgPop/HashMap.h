@@ -0,0 +1,152 @@
+#pragma once
+
+// std
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+
+namespace osgUtil
+{
+
+/**
+ @brief 64 bit finalizer of murmur3, spreads every input bit over the whole hash
+*/
+inline uint64_t mixHash(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return key;
+}
+
+/**
+ @brief Hash functor for integer keys
+*/
+struct IntegerHash
+{
+	size_t operator()(uint64_t key) const
+	{
+		return (size_t)mixHash(key);
+	}
+};
+
+/**
+ @brief Hash functor for osg vectors, hashes the bit pattern of every component
+*/
+template<class Vector> struct VectorHash
+{
+	size_t operator()(const Vector& vector) const
+	{
+		uint64_t hash = 0;
+		for (int i = 0; i < Vector::num_components; ++i)
+		{
+			// adding zero maps -0.0 to 0.0, both compare equal and need the same hash
+			typename Vector::value_type component = vector[i] + typename Vector::value_type(0);
+			uint64_t bits = 0;
+			memcpy(&bits, &component, sizeof(component));
+			hash = mixHash(hash ^ bits);
+		}
+
+		return (size_t)hash;
+	}
+};
+
+/**
+ @brief Hash map with open addressing and linear probing.
+ Keys, values and slot states are stored in flat arrays, so inserting doesn't allocate nodes.
+ Elements can't be removed, which is all the mesh analysis needs.
+*/
+template<class Key, class Value, class Hash> class HashMap
+{
+public:
+	HashMap(size_t expectedSize = 0)
+		: _size(0)
+		, _mask(0)
+	{
+		reserve(expectedSize);
+	}
+
+	void reserve(size_t expectedSize)
+	{
+		// keep the load factor at or below one half
+		size_t capacity = 16;
+		while (capacity < expectedSize * 2) { capacity <<= 1; }
+
+		if (capacity > _used.size()) { rehash(capacity); }
+	}
+
+	/**
+	 @brief inserts value if key is not in the map yet
+	 @return pointer to the value stored for key and true if the value was inserted
+	*/
+	std::pair<Value*, bool> insert(const Key& key, const Value& value)
+	{
+		if ((_size + 1) * 2 > _used.size()) { rehash(std::max<size_t>(16, _used.size() * 2)); }
+
+		size_t slot = findSlot(key);
+		if (_used[slot]) { return std::make_pair(&_values[slot], false); }
+
+		_used[slot] = 1;
+		_keys[slot] = key;
+		_values[slot] = value;
+		++_size;
+
+		return std::make_pair(&_values[slot], true);
+	}
+
+	Value* find(const Key& key)
+	{
+		if (_size == 0) { return NULL; }
+
+		size_t slot = findSlot(key);
+		return _used[slot] ? &_values[slot] : NULL;
+	}
+
+	Value& operator[](const Key& key) { return *insert(key, Value()).first; }
+
+	inline size_t size() const { return _size; }
+	inline bool empty() const { return _size == 0; }
+protected:
+	size_t findSlot(const Key& key) const
+	{
+		size_t slot = _hash(key) & _mask;
+		while (_used[slot] && !(_keys[slot] == key)) { slot = (slot + 1) & _mask; }
+
+		return slot;
+	}
+
+	void rehash(size_t capacity)
+	{
+		std::vector<Key> keys(capacity);
+		std::vector<Value> values(capacity);
+		std::vector<unsigned char> used(capacity, 0);
+		keys.swap(_keys);
+		values.swap(_values);
+		used.swap(_used);
+		_mask = capacity - 1;
+
+		// reinsert old elements, they are unique so we only need to find a free slot
+		for (size_t i = 0; i < used.size(); ++i)
+		{
+			if (!used[i]) { continue; }
+
+			size_t slot = findSlot(keys[i]);
+			_used[slot] = 1;
+			_keys[slot] = keys[i];
+			_values[slot] = values[i];
+		}
+	}
+
+	std::vector<Key>			_keys;
+	std::vector<Value>			_values;
+	std::vector<unsigned char>	_used;
+	size_t						_size;
+	size_t						_mask;
+	Hash						_hash;
+};
+
+}
@@ -0,0 +1,242 @@
+#include "InstancedLevelOfDetailGeometry.h"
+#include "LevelOfDetailDrawElements.h"
+#include "GLFunctions.h"
+
+#include <osg/GL2Extensions>
+#include <osg/Program>
+#include <osgUtil/CullVisitor>
+
+#include <cstring>
+#include <algorithm>
+
+using namespace osg;
+
+namespace osg
+{
+
+static const unsigned char CULLED_INSTANCE = 255u;
+
+struct InstancedPopCullCallback : osg::Drawable::CullCallback
+{
+    virtual bool cull(osg::NodeVisitor* nv, osg::Drawable* drawable, osg::RenderInfo* renderInfo) const
+    {
+        osgUtil::CullVisitor* cv = dynamic_cast<osgUtil::CullVisitor*>(nv);
+        InstancedLevelOfDetailGeometry* lodGeometry = dynamic_cast<InstancedLevelOfDetailGeometry*>(drawable);
+
+		if(cv && lodGeometry)
+        {
+			// computing the bounds of all instances also updates the bounds of the mesh
+			lodGeometry->getBound();
+			const BoundingBox& meshBounds = lodGeometry->_meshBounds;
+
+			// select the lod of every visible instance with its own bounds and scale
+			const std::vector<Matrixf>& matrices = lodGeometry->_instanceMatrices;
+			std::vector<unsigned char> instanceLods(matrices.size(), CULLED_INSTANCE);
+			float requestedLod = 0.0f;
+			for (size_t i = 0; i < matrices.size(); ++i)
+			{
+				float scale = lodGeometry->_instanceScales[i];
+				BoundingSphere bounds(meshBounds.center() * matrices[i], meshBounds.radius() * scale);
+				if (cv->isCulled(bounds)) { continue; }
+
+				float targetLod = lodGeometry->computeTargetLod(cv, bounds, scale);
+				float lod = lodGeometry->applyLodHysteresis(targetLod, lodGeometry->_lastInstanceLods[i]);
+				lodGeometry->_lastInstanceLods[i] = (unsigned char)lod;
+				requestedLod = std::max(requestedLod, lod);
+
+				// the requested lod may not be loaded yet, show the finest one that is
+				instanceLods[i] = (unsigned char)std::min(lod, (float)lodGeometry->getMaxLod());
+			}
+			lodGeometry->_requestedLod = requestedLod;
+
+			lodGeometry->sortInstances(instanceLods);
+
+			// nothing to draw if every instance is culled
+			return lodGeometry->_lodInstanceStart[32] == 0;
+        }
+
+        return false;
+    }
+};
+
+InstancedLevelOfDetailGeometry::InstancedLevelOfDetailGeometry()
+	: LevelOfDetailGeometry()
+	, _instanceTextureUnit(1)
+{
+	initInstancing();
+}
+
+InstancedLevelOfDetailGeometry::InstancedLevelOfDetailGeometry(const LevelOfDetailGeometry& rhs, const CopyOp& copyop)
+	: LevelOfDetailGeometry(rhs, copyop)
+	, _instanceTextureUnit(1)
+{
+	initInstancing();
+}
+
+InstancedLevelOfDetailGeometry::InstancedLevelOfDetailGeometry(const InstancedLevelOfDetailGeometry& rhs, const CopyOp& copyop)
+	: LevelOfDetailGeometry(rhs, copyop)
+	, _instanceTextureUnit(rhs._instanceTextureUnit)
+{
+	initInstancing();
+	setInstanceMatrices(rhs._instanceMatrices);
+}
+
+void InstancedLevelOfDetailGeometry::initInstancing()
+{
+	// the instance texture and the draw counts change every frame
+	setDataVariance(osg::Object::DYNAMIC);
+	setCullCallback(new InstancedPopCullCallback());
+	_lodInstanceStart.assign(33, 0);
+
+	_instanceImage = new Image();
+	// a texture buffer is limited by GL_MAX_TEXTURE_BUFFER_SIZE only, not by the width and height of a 2D texture
+	_instanceTexture = new TextureBuffer();
+	_instanceTexture->setInternalFormat(GL_RGBA32F_ARB);
+	_instanceTexture->setSourceFormat(GL_RGBA);
+	_instanceTexture->setSourceType(GL_FLOAT);
+
+	// a shallow copy shares the state set with the original, give the copy its own texture and offset
+	ref_ptr<StateSet> stateSet = new StateSet(*getOrCreateStateSet(), CopyOp::SHALLOW_COPY);
+	stateSet->setDataVariance(osg::Object::DYNAMIC);
+	stateSet->addUniform(new Uniform("osg_InstanceOffset", 0));
+	setStateSet(stateSet);
+	reconnectUniforms();
+	setInstanceTextureUnit(_instanceTextureUnit);
+}
+
+void InstancedLevelOfDetailGeometry::setInstanceTextureUnit(unsigned int unit)
+{
+	_stateset->removeTextureAttribute(_instanceTextureUnit, _instanceTexture);
+	_instanceTextureUnit = unit;
+	_stateset->setTextureAttributeAndModes(_instanceTextureUnit, _instanceTexture, osg::StateAttribute::ON);
+	_stateset->addUniform(new Uniform("osg_InstanceMatrices", (int)_instanceTextureUnit));
+}
+
+void InstancedLevelOfDetailGeometry::setInstanceMatrices(const std::vector<Matrixf>& instanceMatrices)
+{
+	_instanceMatrices = instanceMatrices;
+	_lastInstanceLods.assign(_instanceMatrices.size(), 31);
+	_lodInstanceStart.assign(33, 0);
+
+	// lod selection scales the errors of the mesh by the largest scale of every instance
+	_instanceScales.resize(_instanceMatrices.size());
+	for (size_t i = 0; i < _instanceMatrices.size(); ++i)
+	{
+		Vec3 scale = _instanceMatrices[i].getScale();
+		_instanceScales[i] = std::max(scale.x(), std::max(scale.y(), scale.z()));
+	}
+
+	// four texels per matrix, an empty buffer can't be created
+	unsigned int width = 4u * std::max((unsigned int)_instanceMatrices.size(), 1u);
+	_instanceImage->allocateImage(width, 1, 1, GL_RGBA, GL_FLOAT);
+	_instanceImage->setInternalTextureFormat(GL_RGBA32F_ARB);
+	_instanceTexture->setImage(_instanceImage);
+	_instanceTexture->setTextureWidth(width);
+
+	dirtyBound();
+}
+
+void InstancedLevelOfDetailGeometry::sortInstances(const std::vector<unsigned char>& instanceLods)
+{
+	// count the instances of every lod and turn the counts into the start of every lod
+	_lodInstanceStart.assign(33, 0);
+	for (auto lod: instanceLods)
+	{
+		if (lod != CULLED_INSTANCE) { ++_lodInstanceStart[lod + 1]; }
+	}
+	for (size_t k = 1; k < _lodInstanceStart.size(); ++k) { _lodInstanceStart[k] += _lodInstanceStart[k-1]; }
+
+	// write the matrices sorted by lod, so every lod reads a contiguous range of the texture
+	std::vector<unsigned int> next(_lodInstanceStart.begin(), _lodInstanceStart.end() - 1);
+	for (size_t i = 0; i < instanceLods.size(); ++i)
+	{
+		if (instanceLods[i] == CULLED_INSTANCE) { continue; }
+
+		unsigned int j = next[instanceLods[i]]++;
+		float* data = (float*)_instanceImage->data(j * 4u);
+		memcpy(data, _instanceMatrices[i].ptr(), 16 * sizeof(float));
+	}
+	_instanceImage->dirty();
+}
+
+BoundingBox InstancedLevelOfDetailGeometry::computeBound() const
+{
+	_meshBounds = LevelOfDetailGeometry::computeBound();
+
+	BoundingBox bounds;
+	if (!_meshBounds.valid()) { return bounds; }
+
+	for (auto& matrix: _instanceMatrices)
+	{
+		for (unsigned int i = 0; i < 8; ++i)
+		{
+			bounds.expandBy(_meshBounds.corner(i) * matrix);
+		}
+	}
+
+	return bounds;
+}
+
+void InstancedLevelOfDetailGeometry::drawImplementation(RenderInfo& renderInfo) const
+{
+	State& state = *renderInfo.getState();
+	const GL2Extensions* extensions = GL2Extensions::Get(state.getContextID(), true);
+	const Program::PerContextProgram* program = state.getLastAppliedProgramObject();
+	GLint lodLocation = program ? program->getUniformLocation("osg_VertexLod") : -1;
+	GLint offsetLocation = program ? program->getUniformLocation("osg_InstanceOffset") : -1;
+
+	// the shader can only fetch the matrices within the texture buffer size of the context
+	unsigned int maxInstances = GLFunctions::getFunctions(state.getContextID())->maxTextureBufferSize / 4;
+
+	// one instanced draw per lod, the uniforms change between the draws of one drawable so they are set directly
+	for (int lod = 0; lod < 32; ++lod)
+	{
+		if (_lodInstanceStart[lod] >= maxInstances) { break; }
+
+		unsigned int numInstances = std::min(getNumInstancesOfLod(lod), maxInstances - _lodInstanceStart[lod]);
+		if (numInstances == 0) { continue; }
+
+		for (auto primitive: _primitives)
+		{
+			LevelOfDetailDrawElements* lodDrawElements = dynamic_cast<LevelOfDetailDrawElements*>(primitive.get());
+			if (lodDrawElements) { lodDrawElements->setLod(lod); }
+			primitive->setNumInstances(numInstances);
+		}
+
+		if (lodLocation >= 0) { extensions->glUniform1f(lodLocation, lod + 1.0f); }
+		if (offsetLocation >= 0) { extensions->glUniform1i(offsetLocation, _lodInstanceStart[lod]); }
+
+		LevelOfDetailGeometry::drawImplementation(renderInfo);
+	}
+
+	// leave the finest loaded lod for bounds, intersections and other visitors
+	for (auto primitive: _primitives)
+	{
+		LevelOfDetailDrawElements* lodDrawElements = dynamic_cast<LevelOfDetailDrawElements*>(primitive.get());
+		if (lodDrawElements) { lodDrawElements->setLod(_maxLod); }
+		primitive->setNumInstances(0);
+	}
+}
+
+std::string InstancedLevelOfDetailGeometry::getVertexShaderUniformDefintion()
+{
+    return LevelOfDetailGeometry::getVertexShaderUniformDefintion() +
+           "uniform samplerBuffer osg_InstanceMatrices;\n"
+           "uniform int osg_InstanceOffset;\n";
+}
+
+std::string InstancedLevelOfDetailGeometry::getVertexShaderFunctionDefinition()
+{
+    return LevelOfDetailGeometry::getVertexShaderFunctionDefinition() +
+           "\n"
+           "mat4 instanceMatrix()\n"
+           "{\n"
+           "    int texel = (gl_InstanceID + osg_InstanceOffset) * 4;\n"
+           "    return mat4(texelFetch(osg_InstanceMatrices, texel),\n"
+           "                texelFetch(osg_InstanceMatrices, texel + 1),\n"
+           "                texelFetch(osg_InstanceMatrices, texel + 2),\n"
+           "                texelFetch(osg_InstanceMatrices, texel + 3));\n"
+           "}\n";
+}
+
+} // namespace osg
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <osg/Matrixf>
+#include <osg/Image>
+#include <osg/TextureBuffer>
+
+#include "LevelOfDetailGeometry.h"
+
+namespace osg
+{
+
+struct InstancedPopCullCallback;
+
+/**
+ @brief Pop buffer geometry drawn once per instance matrix, every instance with its own lod.
+ Each frame the cull traversal selects the lod of every visible instance, sorts the instances by lod and draws every
+ lod that has instances with one instanced draw call. Instance matrices are read from a texture buffer, sorted by
+ lod, and the vertex shader finds the matrix of an instance with gl_InstanceID + osg_InstanceOffset.
+ A texture buffer holds GL_MAX_TEXTURE_BUFFER_SIZE / 4 matrices, instances beyond that are not drawn.
+ Geomorphing is not supported, instances of one draw can't blend differently.
+*/
+class OSG_EXPORT InstancedLevelOfDetailGeometry : public LevelOfDetailGeometry
+{
+public:
+    friend struct InstancedPopCullCallback;
+
+	InstancedLevelOfDetailGeometry();
+	InstancedLevelOfDetailGeometry(const LevelOfDetailGeometry& rhs, const osg::CopyOp& copyop=osg::CopyOp::SHALLOW_COPY);
+	InstancedLevelOfDetailGeometry(const InstancedLevelOfDetailGeometry& rhs, const osg::CopyOp& copyop=osg::CopyOp::SHALLOW_COPY);
+
+    virtual osg::Object* cloneType() const { return new InstancedLevelOfDetailGeometry(); }
+    virtual osg::Object* clone(const osg::CopyOp& copyop) const { return new InstancedLevelOfDetailGeometry(*this,copyop); }
+    virtual bool isSameKindAs(const osg::Object* obj) const { return dynamic_cast<const InstancedLevelOfDetailGeometry*>(obj)!=NULL; }
+    virtual const char* libraryName() const { return "osg"; }
+    virtual const char* className() const { return "InstancedLevelOfDetailGeometry"; }
+
+	void setInstanceMatrices(const std::vector<osg::Matrixf>& instanceMatrices);
+	inline const std::vector<osg::Matrixf>& getInstanceMatrices() const { return _instanceMatrices; }
+
+	/** @brief texture unit of the instance matrix texture, the sampler uniform is osg_InstanceMatrices */
+	void setInstanceTextureUnit(unsigned int unit);
+	inline unsigned int getInstanceTextureUnit() const { return _instanceTextureUnit; }
+
+	/** @brief number of instances drawn with the given lod in the last frame */
+	inline unsigned int getNumInstancesOfLod(int lod) const { return _lodInstanceStart[lod+1] - _lodInstanceStart[lod]; }
+
+	virtual osg::BoundingBox computeBound() const;
+	virtual void drawImplementation(osg::RenderInfo& renderInfo) const;
+
+    static std::string getVertexShaderUniformDefintion();
+    static std::string getVertexShaderFunctionDefinition();
+protected:
+	virtual ~InstancedLevelOfDetailGeometry() {}
+
+	void initInstancing();
+
+	/** @brief sorts the instances by lod with a counting sort and writes their matrices to the instance texture */
+	void sortInstances(const std::vector<unsigned char>& instanceLods);
+
+	std::vector<osg::Matrixf> _instanceMatrices;
+	std::vector<float> _instanceScales;
+	std::vector<unsigned char> _lastInstanceLods;
+	std::vector<unsigned int> _lodInstanceStart;
+	mutable osg::BoundingBox _meshBounds;
+	unsigned int _instanceTextureUnit;
+	osg::ref_ptr<osg::Image> _instanceImage;
+	osg::ref_ptr<osg::TextureBuffer> _instanceTexture;
+};
+
+} // namespace osg
@@ -1,4 +1,5 @@
 #include "LevelOfDetailDrawElements.h"
+#include "GLFunctions.h"
 
 #include <osg/State>
 
@@ -7,6 +8,20 @@ using namespace osg;
 namespace osg
 {
 
+void LevelOfDetailDrawElements::drawRangeElements(State& state, GLenum mode, GLenum type, const GLvoid* indices) const
+{
+    // glDrawRangeElements is not exported by every GL library, every context loads its own
+    GLFunctions::DrawRangeElementsProc glDrawRangeElementsProc = GLFunctions::getFunctions(state.getContextID())->glDrawRangeElementsProc;
+
+    // protected vertices are in front, so every lod uses the vertices from 0 to its vertex end
+    if (glDrawRangeElementsProc && _vertexEnd > 0)
+    {
+        glDrawRangeElementsProc(mode, 0, _vertexEnd - 1, _end, type, indices);
+    } else {
+        glDrawElements(mode, _end, type, indices);
+    }
+}
+
 void LevelOfDetailDrawElementsUByte::draw(State& state, bool useVertexBufferObjects) const
 {
 	GLenum mode = _mode;
@@ -22,18 +37,18 @@ void LevelOfDetailDrawElementsUByte::draw(State& state, bool useVertexBufferObje
         if (ebo)
         {
 			if (_numInstances>=1) state.glDrawElementsInstanced(mode, _end, GL_UNSIGNED_BYTE, (const GLvoid *)(ebo->getOffset(getBufferIndex())), _numInstances);
-            else glDrawElements(mode, _end, GL_UNSIGNED_BYTE, (const GLvoid *)(ebo->getOffset(getBufferIndex())));
+            else drawRangeElements(state, mode, GL_UNSIGNED_BYTE, (const GLvoid *)(ebo->getOffset(getBufferIndex())));
         }
         else
         {
             if (_numInstances>=1) state.glDrawElementsInstanced(mode, _end, GL_UNSIGNED_BYTE, &front(), _numInstances);
-            else glDrawElements(mode, _end, GL_UNSIGNED_BYTE, &front());
+            else drawRangeElements(state, mode, GL_UNSIGNED_BYTE, &front());
         }
     }
     else
     {
         if (_numInstances>=1) state.glDrawElementsInstanced(mode, _end, GL_UNSIGNED_BYTE, &front(), _numInstances);
-        else glDrawElements(mode, _end, GL_UNSIGNED_BYTE, &front());
+        else drawRangeElements(state, mode, GL_UNSIGNED_BYTE, &front());
     }
 }
 
@@ -62,18 +77,18 @@ void LevelOfDetailDrawElementsUShort::draw(State& state, bool useVertexBufferObj
         if (ebo)
         {
 			if (_numInstances>=1) state.glDrawElementsInstanced(mode, _end, GL_UNSIGNED_SHORT, (const GLvoid *)(ebo->getOffset(getBufferIndex())), _numInstances);
-            else glDrawElements(mode, _end, GL_UNSIGNED_SHORT, (const GLvoid *)(ebo->getOffset(getBufferIndex())));
+            else drawRangeElements(state, mode, GL_UNSIGNED_SHORT, (const GLvoid *)(ebo->getOffset(getBufferIndex())));
         }
         else
         {
             if (_numInstances>=1) state.glDrawElementsInstanced(mode, _end, GL_UNSIGNED_SHORT, &front(), _numInstances);
-            else glDrawElements(mode, _end, GL_UNSIGNED_SHORT, &front());
+            else drawRangeElements(state, mode, GL_UNSIGNED_SHORT, &front());
         }
     }
     else
     {
         if (_numInstances>=1) state.glDrawElementsInstanced(mode, _end, GL_UNSIGNED_SHORT, &front(), _numInstances);
-        else glDrawElements(mode, _end, GL_UNSIGNED_SHORT, &front());
+        else drawRangeElements(state, mode, GL_UNSIGNED_SHORT, &front());
     }
 }
 
@@ -102,18 +117,18 @@ void LevelOfDetailDrawElementsUInt::draw(State& state, bool useVertexBufferObjec
         if (ebo)
         {
 			if (_numInstances>=1) state.glDrawElementsInstanced(mode, _end, GL_UNSIGNED_INT, (const GLvoid *)(ebo->getOffset(getBufferIndex())), _numInstances);
-            else glDrawElements(mode, _end, GL_UNSIGNED_INT, (const GLvoid *)(ebo->getOffset(getBufferIndex())));
+            else drawRangeElements(state, mode, GL_UNSIGNED_INT, (const GLvoid *)(ebo->getOffset(getBufferIndex())));
         }
         else
         {
             if (_numInstances>=1) state.glDrawElementsInstanced(mode, _end, GL_UNSIGNED_INT, &front(), _numInstances);
-            else glDrawElements(mode, _end, GL_UNSIGNED_INT, &front());
+            else drawRangeElements(state, mode, GL_UNSIGNED_INT, &front());
         }
     }
     else
     {
         if (_numInstances>=1) state.glDrawElementsInstanced(mode, _end, GL_UNSIGNED_INT, &front(), _numInstances);
-        else glDrawElements(mode, _end, GL_UNSIGNED_INT, &front());
+        else drawRangeElements(state, mode, GL_UNSIGNED_INT, &front());
     }
 }
 
@@ -11,21 +11,43 @@ public:
 	LevelOfDetailDrawElements()
 	    : _lodRange(32) 
         , _end(0)
+        , _vertexEnd(0)
 	{
 	}
 
     LevelOfDetailDrawElements(const LevelOfDetailDrawElements& rhs)
         : _lodRange(rhs._lodRange)
         , _end(rhs._end)
+        , _vertexRange(rhs._vertexRange)
+        , _vertexEnd(rhs._vertexEnd)
     {
     }
 
-    inline void setLod(int lod) { if (lod >= 0 && lod < 32) { _end = _lodRange[lod]; } }
+    inline void setLod(int lod)
+    {
+        if (lod >= 0 && lod < 32)
+        {
+            _end = _lodRange[lod];
+            _vertexEnd = _vertexRange.empty() ? 0 : _vertexRange[lod];
+        }
+    }
     inline void setLodRanges(const std::vector<GLint>& lodRange) { _lodRange = lodRange; }
     inline std::vector<GLint> getLodRanges() const { return _lodRange; }
+
+    /** @brief number of indices drawn by the lod */
+    inline GLint getLodRange(int lod) const { return _lodRange[lod]; }
+
+    /** @brief number of vertices each lod references, vertices of a lod have to be in front of the vertices first used by finer lods */
+    inline void setVertexRanges(const std::vector<GLint>& vertexRange) { _vertexRange = vertexRange; }
+    inline std::vector<GLint> getVertexRanges() const { return _vertexRange; }
 protected:
+    /** @brief draws with glDrawRangeElements if vertex ranges are set */
+    void drawRangeElements(State& state, GLenum mode, GLenum type, const GLvoid* indices) const;
+
     std::vector<GLint> _lodRange;
 	GLint _end;
+    std::vector<GLint> _vertexRange;
+    GLint _vertexEnd;
 };
 
 class OSG_EXPORT LevelOfDetailDrawElementsUByte : public LevelOfDetailDrawElements, public osg::DrawElementsUByte
@@ -47,7 +69,9 @@ public:
         : osg::DrawElementsUByte(array,copyop)
         , LevelOfDetailDrawElements(array)
     {
+		// the copy draws all indices, so it has to declare the vertex range of the finest lod
 		_end = size();
+		_vertexEnd = _vertexRange.empty() ? 0 : _vertexRange.back();
 	}
 
 	virtual void draw(osg::State& state, bool useVertexBufferObjects) const;
@@ -74,7 +98,9 @@ public:
         : osg::DrawElementsUShort(array,copyop)
         , LevelOfDetailDrawElements(array)
     {
+		// the copy draws all indices, so it has to declare the vertex range of the finest lod
 		_end = size();
+		_vertexEnd = _vertexRange.empty() ? 0 : _vertexRange.back();
 	}
 
 	virtual void draw(osg::State& state, bool useVertexBufferObjects) const;
@@ -101,7 +127,9 @@ public:
         : osg::DrawElementsUInt(array,copyop)
         , LevelOfDetailDrawElements(array)
     {
+		// the copy draws all indices, so it has to declare the vertex range of the finest lod
 		_end = size();
+		_vertexEnd = _vertexRange.empty() ? 0 : _vertexRange.back();
 	}
 
 	virtual void draw(osg::State& state, bool useVertexBufferObjects) const;
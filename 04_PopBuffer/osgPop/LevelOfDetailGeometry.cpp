@@ -1,8 +1,11 @@
 #include "LevelOfDetailGeometry.h"
 #include "LevelOfDetailDrawElements.h"
+#include "TriangleBudgetCallback.h"
 
 #include <osgUtil/CullVisitor>
 
+#include <atomic>
+
 using namespace osg;
 
 namespace osg
@@ -13,6 +16,13 @@ double log2(double n)
     return log(n) / log(2);  
 }
 
+static std::atomic<unsigned int> s_numLodTransitions(0);
+
+unsigned int LevelOfDetailGeometry::resetNumLodTransitions()
+{
+    return s_numLodTransitions.exchange(0);
+}
+
 struct PopCullCallback : osg::Drawable::CullCallback
 {
     virtual bool cull(osg::NodeVisitor* nv, osg::Drawable* drawable, osg::RenderInfo* renderInfo) const
@@ -22,13 +32,32 @@ struct PopCullCallback : osg::Drawable::CullCallback
 
 		if(cv && lodGeometry)
         {
-            // calculate error metric
-			osg::BoundingSphere bs(lodGeometry->getBound().center(), lodGeometry->getMaxBounds() - lodGeometry->getMinBounds());
-			float screenSize = cv->clampedPixelSize(bs);
-			float lod = ceilf(log2(screenSize / (lodGeometry->getMaxViewSpaceError() * cv->getLODScale()))) - 1.0f;
-	        lod = std::max(std::min(lod, 31.0f), 0.0f);
+			const osg::BoundingBox& bounds = lodGeometry->getBound();
 
-			lodGeometry->setLod(lod);
+			// a triangle budget of the camera chooses the lods of all visible geometries once the camera is traversed
+			TriangleBudgetCallback* triangleBudget = TriangleBudgetCallback::getTriangleBudget(cv);
+			if (triangleBudget)
+			{
+				if (cv->isCulled(bounds)) { return true; }
+
+				triangleBudget->addGeometry(lodGeometry, lodGeometry->computePixelsPerUnit(cv, osg::BoundingSphere(bounds.center(), bounds.radius())),
+				                            lodGeometry->getMaxViewSpaceError() * cv->getLODScale());
+				return false;
+			}
+
+			float targetLod = lodGeometry->computeTargetLod(cv, osg::BoundingSphere(bounds.center(), bounds.radius()));
+			if (!lodGeometry->getGeomorphing())
+			{
+				lodGeometry->setLod(lodGeometry->applyLodHysteresis(targetLod, lodGeometry->_lastLod));
+				return false;
+			}
+
+			// geomorphing blends from the previous lod, so triangles of the new lod grow out of degenerated ones.
+			// The blend is 0 where the lod switches, so the vertices move continuously and need no hysteresis,
+			// a lod held by the hysteresis would jump by the blend it missed when it switches.
+			float lod = std::max(std::min(ceilf(targetLod), 31.0f), 0.0f);
+			float blend = std::max(std::min(targetLod - (lod - 1.0f), 1.0f), 0.0f);
+			lodGeometry->setLod(lod, blend);
         }
         
         return false;
@@ -40,26 +69,47 @@ struct PopCullCallback : osg::Drawable::CullCallback
 LevelOfDetailGeometry::LevelOfDetailGeometry()
 	: Geometry()
 	, _lastLod(31)
-	, _min(FLT_MIN)
-	, _max(FLT_MAX)
+	, _min(FLT_MIN, FLT_MIN, FLT_MIN)
+	, _max(FLT_MAX, FLT_MAX, FLT_MAX)
 	, _numProtectedVertices(0)
 	, _lodUniform(new osg::Uniform("osg_VertexLod", 32.0f))
-	, _minBoundsUniform(new osg::Uniform("osg_MinBounds", osg::Vec3(_min, _min, _min)))
-	, _maxBoundsUniform(new osg::Uniform("osg_MaxBounds", osg::Vec3(_max, _max, _max)))
+	, _lodBlendUniform(new osg::Uniform("osg_VertexLodBlend", 1.0f))
+	, _minBoundsUniform(new osg::Uniform("osg_MinBounds", _min))
+	, _maxBoundsUniform(new osg::Uniform("osg_MaxBounds", _max))
 	, _numProtectedVerticesUniform(new osg::Uniform("osg_ProtectedVertices", _numProtectedVertices))
+	, _compressedAttributes(0)
+	, _compressedAttributesUniform(new osg::Uniform("osg_CompressedAttributes", _compressedAttributes))
+	, _compressionOrigin(0.0f, 0.0f, 0.0f)
+	, _compressionStep(1.0f, 1.0f, 1.0f)
+	, _compressionOriginUniform(new osg::Uniform("osg_CompressionOrigin", _compressionOrigin))
+	, _compressionStepUniform(new osg::Uniform("osg_CompressionStep", _compressionStep))
+	, _compressionOffsetUniform(new osg::Uniform("osg_CompressionOffset", 0, 0, 0))
 	, _maxViewSpaceError(1.0f) 
+	, _lodHysteresis(0.25f)
+	, _geomorphing(false)
+	, _maxLod(31)
+	, _requestedLod(0.0f)
 {
+	for (int i = 0; i < 3; ++i) { _compressionOffset[i] = 0; }
+
+	// lod changes only change the draw count, display lists would have to be recompiled
 	setSupportsDisplayList(true);
-	setUseDisplayList(true);
+	setUseDisplayList(false);
 	setUseVertexBufferObjects(true);
 
     setCullCallback(new PopCullCallback());
 
 	_lodUniform->setDataVariance(osg::Object::DYNAMIC);
+	_lodBlendUniform->setDataVariance(osg::Object::DYNAMIC);
 	getOrCreateStateSet()->addUniform(_lodUniform);
+	_stateset->addUniform(_lodBlendUniform);
 	_stateset->addUniform(_minBoundsUniform);
 	_stateset->addUniform(_maxBoundsUniform);
 	_stateset->addUniform(_numProtectedVerticesUniform);
+	_stateset->addUniform(_compressedAttributesUniform);
+	_stateset->addUniform(_compressionOriginUniform);
+	_stateset->addUniform(_compressionStepUniform);
+	_stateset->addUniform(_compressionOffsetUniform);
 }
 
 LevelOfDetailGeometry::LevelOfDetailGeometry(const LevelOfDetailGeometry& rhs, const CopyOp& copyop)
@@ -67,25 +117,123 @@ LevelOfDetailGeometry::LevelOfDetailGeometry(const LevelOfDetailGeometry& rhs, c
 	, _lastLod(31)
 	, _min(rhs._min)
 	, _max(rhs._max)
+	, _lodErrors(rhs._lodErrors)
 	, _numProtectedVertices(rhs._numProtectedVertices)
 	, _lodUniform(copyop(rhs._lodUniform))
+	, _lodBlendUniform(copyop(rhs._lodBlendUniform))
 	, _minBoundsUniform(copyop(rhs._minBoundsUniform))
 	, _maxBoundsUniform(copyop(rhs._maxBoundsUniform))
 	, _numProtectedVerticesUniform(copyop(rhs._numProtectedVerticesUniform))
+	, _compressedAttributes(rhs._compressedAttributes)
+	, _compressedAttributesUniform(copyop(rhs._compressedAttributesUniform))
+	, _compressionOrigin(rhs._compressionOrigin)
+	, _compressionStep(rhs._compressionStep)
+	, _compressionOriginUniform(copyop(rhs._compressionOriginUniform))
+	, _compressionStepUniform(copyop(rhs._compressionStepUniform))
+	, _compressionOffsetUniform(copyop(rhs._compressionOffsetUniform))
 	, _maxViewSpaceError(rhs._maxViewSpaceError)
+	, _lodHysteresis(rhs._lodHysteresis)
+	, _geomorphing(rhs._geomorphing)
+	, _maxLod(rhs._maxLod)
+	, _requestedLod(0.0f)
 {
+	for (int i = 0; i < 3; ++i) { _compressionOffset[i] = rhs._compressionOffset[i]; }
+
 	setSupportsDisplayList(true);
-	setUseDisplayList(true);
+	setUseDisplayList(false);
 	setUseVertexBufferObjects(true);
 
 	getOrCreateStateSet()->addUniform(_lodUniform);
+	_stateset->addUniform(_lodBlendUniform);
 	_stateset->addUniform(_minBoundsUniform);
 	_stateset->addUniform(_maxBoundsUniform);
 	_stateset->addUniform(_numProtectedVerticesUniform);
+	_stateset->addUniform(_compressedAttributesUniform);
+	_stateset->addUniform(_compressionOriginUniform);
+	_stateset->addUniform(_compressionStepUniform);
+	_stateset->addUniform(_compressionOffsetUniform);
+}
+
+float LevelOfDetailGeometry::computeTargetLod(osgUtil::CullVisitor* cv, const osg::BoundingSphere& bounds, float scale) const
+{
+    float maxError = getMaxViewSpaceError() * cv->getLODScale();
+
+    // without measured errors estimate the lod from the screen size of the quantization bounds
+    if (_lodErrors.empty())
+    {
+        float screenSize = cv->clampedPixelSize(osg::BoundingSphere(bounds.center(), (_max - _min).length() * scale));
+        return log2(screenSize / maxError) - 1.0f;
+    }
+
+    float pixelsPerUnit = computePixelsPerUnit(cv, bounds, scale);
+
+    // the coarsest lod within the maximum error, between two lods interpolate the logarithm of the projected errors
+    for (size_t k = 0; k < _lodErrors.size(); ++k)
+    {
+        float error = _lodErrors[k] * pixelsPerUnit;
+        if (error > maxError) { continue; }
+        if (k == 0) { return 0.0f; }
+
+        float previousError = _lodErrors[k-1] * pixelsPerUnit;
+        float t = (error > 0.0f) ? log2(previousError / maxError) / log2(previousError / error) : 1.0f;
+        return float(k - 1) + t;
+    }
+
+    return float(_lodErrors.size() - 1);
 }
 
-void LevelOfDetailGeometry::setLod(float lod)
+float LevelOfDetailGeometry::computePixelsPerUnit(osgUtil::CullVisitor* cv, const osg::BoundingSphere& bounds, float scale) const
 {
+    osg::Vec3 toEye = cv->getEyeLocal() - bounds.center();
+    float distance = toEye.length();
+    osg::Vec3 nearest = (distance > bounds.radius()) ? bounds.center() + toEye * (bounds.radius() / distance) : cv->getEyeLocal();
+    return cv->clampedPixelSize(nearest, scale);
+}
+
+float LevelOfDetailGeometry::getLodError(int lod) const
+{
+    if (lod >= 0 && lod < (int)_lodErrors.size()) { return _lodErrors[lod]; }
+
+    // lod k quantizes every axis to 2^(k+1) steps
+    return ldexpf((_max - _min).length(), -(lod + 1));
+}
+
+unsigned int LevelOfDetailGeometry::getNumTriangles(int lod) const
+{
+    unsigned int numIndices = 0;
+    for (auto primitive: _primitives)
+    {
+        const LevelOfDetailDrawElements* lodDrawElements = dynamic_cast<const LevelOfDetailDrawElements*>(primitive.get());
+        numIndices += lodDrawElements ? lodDrawElements->getLodRange(lod) : primitive->getNumIndices();
+    }
+
+    return numIndices / 3;
+}
+
+float LevelOfDetailGeometry::applyLodHysteresis(float targetLod, int currentLod) const
+{
+    float lod = ceilf(targetLod);
+
+    // keep the current lod until the target is more than the hysteresis beyond its boundaries
+    if ((lod > currentLod && targetLod <= currentLod + _lodHysteresis) ||
+        (lod < currentLod && targetLod > currentLod - 1.0f - _lodHysteresis))
+    {
+        lod = float(currentLod);
+    }
+
+    return std::max(std::min(lod, 31.0f), 0.0f);
+}
+
+void LevelOfDetailGeometry::setLod(float lod, float blend)
+{
+    _requestedLod = lod;
+    if (lod > _maxLod)
+    {
+        // the requested lod is not loaded, show the finest one that is
+        lod = (float)_maxLod;
+        blend = 1.0f;
+    }
+
     for (auto primitive: _primitives)
     {
         LevelOfDetailDrawElements* lodDrawElements = dynamic_cast<LevelOfDetailDrawElements*>(primitive.get());
@@ -98,22 +246,54 @@ void LevelOfDetailGeometry::setLod(float lod)
 
     _lodUniform->set(floor(lod)+1.0f);
 	_lodUniform->dirty();
+    _lodBlendUniform->set(blend);
+	_lodBlendUniform->dirty();
 
 	if((int)lod != _lastLod)
 	{
-		dirtyDisplayList();
+		if (getUseDisplayList()) { dirtyDisplayList(); }
 		_lastLod = (int)lod;
+		++s_numLodTransitions;
 	}
 }
 
 void LevelOfDetailGeometry::updateUniforms()
 {
-	_minBoundsUniform->set(osg::Vec3(_min, _min, _min));
-	_maxBoundsUniform->set(osg::Vec3(_max, _max, _max));
+	_minBoundsUniform->set(_min);
+	_maxBoundsUniform->set(_max);
 	_numProtectedVerticesUniform->set(_numProtectedVertices);
 	_minBoundsUniform->dirty();
 	_maxBoundsUniform->dirty();
 	_numProtectedVerticesUniform->dirty();
+	_compressedAttributesUniform->set(_compressedAttributes);
+	_compressedAttributesUniform->dirty();
+	_compressionOriginUniform->set(_compressionOrigin);
+	_compressionStepUniform->set(_compressionStep);
+	_compressionOffsetUniform->set(_compressionOffset[0], _compressionOffset[1], _compressionOffset[2]);
+	_compressionOriginUniform->dirty();
+	_compressionStepUniform->dirty();
+	_compressionOffsetUniform->dirty();
+}
+
+void LevelOfDetailGeometry::setCompressionGrid(const osg::Vec3& origin, const osg::Vec3& step, const int offset[3])
+{
+	_compressionOrigin = origin;
+	_compressionStep = step;
+	for (int i = 0; i < 3; ++i) { _compressionOffset[i] = offset[i]; }
+	updateUniforms();
+	dirtyBound();
+}
+
+BoundingBox LevelOfDetailGeometry::computeBound() const
+{
+    const Vec3sArray* vertices = dynamic_cast<const Vec3sArray*>(getVertexArray());
+    if (!(_compressedAttributes & COMPRESSED_VERTICES) || !vertices) { return Geometry::computeBound(); }
+
+    // the bound functors don't know 16 bit vertices, decode them like the shader does
+    BoundingBox bounds;
+    for (auto& vertex: *vertices) { bounds.expandBy(decodeVertex(vertex)); }
+
+    return bounds;
 }
 
 void LevelOfDetailGeometry::reconnectUniforms()
@@ -122,6 +302,9 @@ void LevelOfDetailGeometry::reconnectUniforms()
     {
         osg::Uniform* lodUniform = _stateset->getUniform("osg_VertexLod");
         if (lodUniform) { _lodUniform = lodUniform; }
+
+        osg::Uniform* lodBlendUniform = _stateset->getUniform("osg_VertexLodBlend");
+        if (lodBlendUniform) { _lodBlendUniform = lodBlendUniform; }
             
         osg::Uniform* minBoundsUniform = _stateset->getUniform("osg_MinBounds");
         if (minBoundsUniform) { _minBoundsUniform = minBoundsUniform; }
@@ -131,31 +314,103 @@ void LevelOfDetailGeometry::reconnectUniforms()
 
         osg::Uniform* numFixedVerticesUniform = _stateset->getUniform("osg_ProtectedVertices");
         if (numFixedVerticesUniform) { _numProtectedVerticesUniform = numFixedVerticesUniform; }
+
+        osg::Uniform* compressedAttributesUniform = _stateset->getUniform("osg_CompressedAttributes");
+        if (compressedAttributesUniform) { _compressedAttributesUniform = compressedAttributesUniform; }
+
+        osg::Uniform* compressionOriginUniform = _stateset->getUniform("osg_CompressionOrigin");
+        if (compressionOriginUniform) { _compressionOriginUniform = compressionOriginUniform; }
+
+        osg::Uniform* compressionStepUniform = _stateset->getUniform("osg_CompressionStep");
+        if (compressionStepUniform) { _compressionStepUniform = compressionStepUniform; }
+
+        osg::Uniform* compressionOffsetUniform = _stateset->getUniform("osg_CompressionOffset");
+        if (compressionOffsetUniform) { _compressionOffsetUniform = compressionOffsetUniform; }
     }
 }
 
+void LevelOfDetailGeometry::addPackedAttributeBindings(Program* program)
+{
+    program->addBindAttribLocation("osg_PackedNormal", PACKED_NORMAL_ATTRIBUTE);
+    program->addBindAttribLocation("osg_PackedTexCoord", PACKED_TEXCOORD_ATTRIBUTE);
+}
+
 std::string LevelOfDetailGeometry::getVertexShaderUniformDefintion()
 {
     return "uniform vec3 osg_MinBounds;\n"
            "uniform vec3 osg_MaxBounds;\n"
            "uniform float osg_VertexLod;\n"
-           "uniform int osg_ProtectedVertices;\n";
+           "uniform float osg_VertexLodBlend;\n"
+           "uniform int osg_ProtectedVertices;\n"
+           "uniform int osg_CompressedAttributes;\n"
+           "uniform vec3 osg_CompressionOrigin;\n"
+           "uniform vec3 osg_CompressionStep;\n"
+           "uniform ivec3 osg_CompressionOffset;\n"
+           "in vec2 osg_PackedNormal;\n"
+           "in vec2 osg_PackedTexCoord;\n";
 }
 
 std::string LevelOfDetailGeometry::getVertexShaderFunctionDefinition()
 {
-    return "vec4 quantizeVertex(vec4 vertex)\n"
+    return "vec4 decodeVertex(vec4 vertex)\n"
+           "{\n"
+           "    // 16 bit integers on a grid shared by the geometries converted together, offset to the geometry\n"
+           "    if ((osg_CompressedAttributes & 1) == 0) { return vertex; }\n"
+           "    ivec3 index = ivec3(vertex.xyz) + 32768 + osg_CompressionOffset;\n"
+           "    return vec4(osg_CompressionOrigin + vec3(index) * osg_CompressionStep, 1.0);\n"
+           "}\n"
+           "\n"
+           "vec3 decodeNormal()\n"
+           "{\n"
+           "    // octahedral mapping, the lower half of the octahedron is folded over the upper one\n"
+           "    if ((osg_CompressedAttributes & 2) == 0) { return gl_Normal; }\n"
+           "    vec3 normal = vec3(osg_PackedNormal, 1.0 - abs(osg_PackedNormal.x) - abs(osg_PackedNormal.y));\n"
+           "    float fold = max(-normal.z, 0.0);\n"
+           "    normal.x += (normal.x >= 0.0) ? -fold : fold;\n"
+           "    normal.y += (normal.y >= 0.0) ? -fold : fold;\n"
+           "    return normalize(normal);\n"
+           "}\n"
+           "\n"
+           "float decodeHalf(uint bits)\n"
+           "{\n"
+           "    float signFactor = ((bits & 0x8000u) != 0u) ? -1.0 : 1.0;\n"
+           "    int exponent = int((bits >> 10) & 0x1Fu);\n"
+           "    float mantissa = float(bits & 0x3FFu);\n"
+           "    if (exponent == 0) { return signFactor * mantissa * exp2(-24.0); }\n"
+           "    return signFactor * (1.0 + mantissa / 1024.0) * exp2(float(exponent - 15));\n"
+           "}\n"
+           "\n"
+           "vec2 decodeTexCoord()\n"
+           "{\n"
+           "    // the bits of half floats, passed as unnormalized unsigned shorts\n"
+           "    if ((osg_CompressedAttributes & 4) == 0) { return gl_MultiTexCoord0.st; }\n"
+           "    return vec2(decodeHalf(uint(osg_PackedTexCoord.x + 0.5)), decodeHalf(uint(osg_PackedTexCoord.y + 0.5)));\n"
+           "}\n"
+           "\n"
+           "vec3 quantizePosition(vec3 position, float bits)\n"
+           "{\n"
+		   "    vec3 factor = (pow(2.0, bits) - 1.0f) / (osg_MaxBounds-osg_MinBounds);\n"
+		   "    vec3 invFactor = (osg_MaxBounds-osg_MinBounds) / pow(2.0, bits);\n"
+		   "    uvec3 q_vertex = uvec3(factor * (position-osg_MinBounds) + 0.5);\n"
+		   "    return invFactor * vec3(q_vertex) + osg_MinBounds;\n"
+           "}\n"
+           "\n"
+           "vec4 quantizeVertex(vec4 vertex)\n"
            "{\n"
+           "    vertex = decodeVertex(vertex);\n"
 	       "    if (gl_VertexID < osg_ProtectedVertices)\n"
 	       "    {\n"
 		   "        return vertex;\n"
 	       "    }\n"
 	       "    else\n"
 	       "    {\n"
-		   "        float factor = (pow(2.0, osg_VertexLod) - 1.0f) / (osg_MaxBounds.x-osg_MinBounds.x);\n"
-		   "        float invFactor = (osg_MaxBounds.x-osg_MinBounds.x) / pow(2.0, osg_VertexLod);\n"
-		   "        uvec3 q_vertex = uvec3(factor * (vertex.xyz-osg_MinBounds) + 0.5);\n"
-		   "        return vec4(invFactor * vec3(q_vertex) + osg_MinBounds, 1.0);\n"
+		   "        vec3 position = quantizePosition(vertex.xyz, osg_VertexLod);\n"
+		   "        // geomorphing: blend from the position of the previous lod\n"
+		   "        if (osg_VertexLodBlend < 1.0)\n"
+		   "        {\n"
+		   "            position = mix(quantizePosition(vertex.xyz, osg_VertexLod - 1.0), position, osg_VertexLodBlend);\n"
+		   "        }\n"
+		   "        return vec4(position, 1.0);\n"
 	       "    }\n"
            "};\n";
 }
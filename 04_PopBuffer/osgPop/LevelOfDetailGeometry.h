@@ -2,19 +2,40 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
 #include <osg/Geode>
 #include <osg/Geometry>
+#include <osg/Program>
 
+namespace osgUtil
+{
+class CullVisitor;
+}
 
 namespace osg
 {
 
 struct PopCullCallback;
+class TriangleBudgetCallback;
 
 class OSG_EXPORT LevelOfDetailGeometry : public osg::Geometry
 {
 public:
     friend struct PopCullCallback;
+    friend class TriangleBudgetCallback;
+
+	/** @brief attributes the converter stored compressed, the shader prelude decodes them */
+	enum CompressedAttributes {
+		COMPRESSED_VERTICES = 1,
+		COMPRESSED_NORMALS = 2,
+		COMPRESSED_TEXCOORDS = 4
+	};
+
+	/** @brief vertex attribute locations of the compressed normals and texture coordinates */
+	enum PackedAttributeLocations {
+		PACKED_NORMAL_ATTRIBUTE = 6,
+		PACKED_TEXCOORD_ATTRIBUTE = 7
+	};
 
 	LevelOfDetailGeometry();
 	LevelOfDetailGeometry(const LevelOfDetailGeometry& rhs, const osg::CopyOp& copyop=osg::CopyOp::SHALLOW_COPY);
@@ -25,11 +46,45 @@ public:
     virtual const char* libraryName() const { return "osg"; }
     virtual const char* className() const { return "LevelOfDetailGeometry"; }
 
-    inline void setMinBounds(float min) { _min = min; updateUniforms(); }
-	inline float getMinBounds() const { return _min; }
-
-	inline void setMaxBounds(float max) { _max = max; updateUniforms(); }
-	inline float getMaxBounds() const { return _max; }
+	/** @brief quantization bounds, every axis is quantized between its own min and max */
+    inline void setMinBounds(const osg::Vec3& min) { _min = min; updateUniforms(); }
+	inline const osg::Vec3& getMinBounds() const { return _min; }
+
+	inline void setMaxBounds(const osg::Vec3& max) { _max = max; updateUniforms(); }
+	inline const osg::Vec3& getMaxBounds() const { return _max; }
+
+	/**
+	 @brief maximum object space distance between the original and the quantized vertices of every lod.
+	 The cull callback projects these errors to pixels to select the lod, without them the lod is estimated from the bounds.
+	*/
+	inline void setLodErrors(const std::vector<float>& lodErrors) { _lodErrors = lodErrors; }
+	inline const std::vector<float>& getLodErrors() const { return _lodErrors; }
+
+	/**
+	 @brief which attributes are compressed, a combination of CompressedAttributes.
+	 Vertices are 16 bit integers on the compression grid, normals octahedral 2x16 bit in PACKED_NORMAL_ATTRIBUTE
+	 and the first texture coordinates half floats in PACKED_TEXCOORD_ATTRIBUTE.
+	*/
+	inline void setCompressedAttributes(int compressedAttributes) { _compressedAttributes = compressedAttributes; updateUniforms(); dirtyBound(); }
+	inline int getCompressedAttributes() const { return _compressedAttributes; }
+
+	/**
+	 @brief grid of the compressed vertices, vertex v decodes to origin + (v + 32768 + offset) * step.
+	 Geometries converted together share the origin and step and only differ in the integer offset,
+	 so a vertex on the seam of two geometries decodes to the same position in both.
+	*/
+	void setCompressionGrid(const osg::Vec3& origin, const osg::Vec3& step, const int offset[3]);
+	inline const osg::Vec3& getCompressionOrigin() const { return _compressionOrigin; }
+	inline const osg::Vec3& getCompressionStep() const { return _compressionStep; }
+	inline int getCompressionOffset(int axis) const { return _compressionOffset[axis]; }
+
+	/** @brief position of a compressed vertex, computed like the shader prelude does */
+	inline osg::Vec3 decodeVertex(const osg::Vec3s& vertex) const
+	{
+		return osg::Vec3(_compressionOrigin.x() + float(int(vertex.x()) + 32768 + _compressionOffset[0]) * _compressionStep.x(),
+		                 _compressionOrigin.y() + float(int(vertex.y()) + 32768 + _compressionOffset[1]) * _compressionStep.y(),
+		                 _compressionOrigin.z() + float(int(vertex.z()) + 32768 + _compressionOffset[2]) * _compressionStep.z());
+	}
 
 	inline void setNumberOfProtectedVertices(int numProtectedVertices) { _numProtectedVertices = numProtectedVertices; updateUniforms(); }
 	inline int getNumberOfProtectedVertices() const { return _numProtectedVertices; }
@@ -37,26 +92,87 @@ public:
 	inline void setMaxViewSpaceError(float maxViewSpaceError) { _maxViewSpaceError = std::abs(maxViewSpaceError); }
 	inline float getMaxViewSpaceError() const { return _maxViewSpaceError; }
 
+	/** @brief how far, in lod levels, the error metric has to pass a lod boundary before the lod changes */
+	inline void setLodHysteresis(float lodHysteresis) { _lodHysteresis = std::max(0.0f, lodHysteresis); }
+	inline float getLodHysteresis() const { return _lodHysteresis; }
+
+	/** @brief blends vertices continuously between lods instead of snapping them, which replaces the lod hysteresis, see getVertexShaderFunctionDefinition() */
+	inline void setGeomorphing(bool geomorphing) { _geomorphing = geomorphing; }
+	inline bool getGeomorphing() const { return _geomorphing; }
+
+	/** @brief returns the number of lod changes of all pop buffer geometries since the last call */
+	static unsigned int resetNumLodTransitions();
+
+	/** @brief limits the lod to the levels that are available, e.g. while a progressive file is still loading */
+	inline void setMaxLod(int maxLod) { _maxLod = maxLod; }
+	inline int getMaxLod() const { return _maxLod; }
+
+	/** @brief lod the last cull traversal asked for, before it was limited by the maximum lod */
+	inline float getRequestedLod() const { return _requestedLod; }
+
+	/**
+	 @brief continuous lod the geometry needs to stay within the maximum view space error
+	 @param bounds bounds of the geometry in the local coordinates of the cull visitor
+	 @param scale length of one object space unit in these coordinates
+	*/
+	float computeTargetLod(osgUtil::CullVisitor* cv, const osg::BoundingSphere& bounds, float scale=1.0f) const;
+
+	/**
+	 @brief object space units per pixel at the point of the bounds nearest to the eye, where the lod errors project largest
+	 @param bounds bounds of the geometry in the local coordinates of the cull visitor
+	 @param scale length of one object space unit in these coordinates
+	*/
+	float computePixelsPerUnit(osgUtil::CullVisitor* cv, const osg::BoundingSphere& bounds, float scale=1.0f) const;
+
+	/** @brief measured object space error of a lod, or the quantization step of the bounds if the errors weren't measured */
+	float getLodError(int lod) const;
+
+	/** @brief number of triangles the lod draws */
+	unsigned int getNumTriangles(int lod) const;
+
+	/** @brief rounds the target lod up, unless it is within the hysteresis of the current lod */
+	float applyLodHysteresis(float targetLod, int currentLod) const;
+
+	/** @brief bounds of the decoded vertices if they are compressed */
+	virtual osg::BoundingBox computeBound() const;
+
     void reconnectUniforms();
 
+    /** @brief binds the packed attributes of compressed geometries to their locations in a program using the shader prelude */
+    static void addPackedAttributeBindings(osg::Program* program);
+
     static std::string getVertexShaderUniformDefintion();
     static std::string getVertexShaderFunctionDefinition();
 protected:
-	void setLod(float lod);
+	void setLod(float lod, float blend=1.0f);
 	void updateUniforms();
 
 	virtual ~LevelOfDetailGeometry() {}
 
     GLint _lastLod;
-	float _min;
-	float _max;
+	osg::Vec3 _min;
+	osg::Vec3 _max;
+	std::vector<float> _lodErrors;
     int _numProtectedVertices;
 	osg::ref_ptr<osg::Uniform> _lodUniform;
+	osg::ref_ptr<osg::Uniform> _lodBlendUniform;
 	osg::ref_ptr<osg::Uniform> _minBoundsUniform;
 	osg::ref_ptr<osg::Uniform> _maxBoundsUniform;
 	osg::ref_ptr<osg::Uniform> _numProtectedVerticesUniform;
+	int _compressedAttributes;
+	osg::ref_ptr<osg::Uniform> _compressedAttributesUniform;
+	osg::Vec3 _compressionOrigin;
+	osg::Vec3 _compressionStep;
+	int _compressionOffset[3];
+	osg::ref_ptr<osg::Uniform> _compressionOriginUniform;
+	osg::ref_ptr<osg::Uniform> _compressionStepUniform;
+	osg::ref_ptr<osg::Uniform> _compressionOffsetUniform;
 
 	float _maxViewSpaceError;
+	float _lodHysteresis;
+	bool _geomorphing;
+	int _maxLod;
+	float _requestedLod;
 };
 
 } // namespace osg
\ No newline at end of file
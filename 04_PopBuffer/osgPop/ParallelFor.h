@@ -0,0 +1,49 @@
+#pragma once
+
+// std
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+namespace osgUtil
+{
+
+/**
+ @brief returns the number of threads to use, 0 means one thread per hardware core
+*/
+inline unsigned int resolveNumThreads(unsigned int numThreads)
+{
+	if (numThreads == 0) { numThreads = std::thread::hardware_concurrency(); }
+	return std::max(1u, numThreads);
+}
+
+/**
+ @brief calls function(i) for every i in [0, numTasks) on numThreads threads.
+ Idle threads take the next unprocessed task from a shared counter, so long tasks don't stall the others.
+*/
+template<class Function> void parallelFor(size_t numTasks, unsigned int numThreads, const Function& function)
+{
+	numThreads = std::min<size_t>(resolveNumThreads(numThreads), numTasks);
+
+	if (numThreads <= 1)
+	{
+		for (size_t i = 0; i < numTasks; ++i) { function(i); }
+		return;
+	}
+
+	std::atomic<size_t> nextTask(0);
+	auto worker = [&]()
+	{
+		for (size_t i = nextTask++; i < numTasks; i = nextTask++) { function(i); }
+	};
+
+	// the calling thread works as well
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < numThreads; ++i) { threads.push_back(std::thread(worker)); }
+	worker();
+
+	for (auto& thread: threads) { thread.join(); }
+}
+
+}
@@ -0,0 +1,523 @@
+#include "PopFile.h"
+#include "LevelOfDetailDrawElements.h"
+
+#include <cstring>
+#include <climits>
+#include <algorithm>
+
+#include <osg/Notify>
+#include <osg/Array>
+
+using namespace std;
+using namespace osg;
+
+namespace osgUtil
+{
+
+namespace
+{
+
+const size_t VERTEX_SIZE = 3 * sizeof(float);
+const size_t NORMAL_SIZE = 3 * sizeof(float);
+const size_t TEXCOORD_SIZE = 2 * sizeof(float);
+
+template<class T> void writeValue(ostream& stream, const T& value)
+{
+	stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<class T> bool readValue(istream& stream, T& value)
+{
+	return !stream.read(reinterpret_cast<char*>(&value), sizeof(T)).fail();
+}
+
+template<class T> void writeArray(ostream& stream, const vector<T>& values)
+{
+	if (!values.empty()) { stream.write(reinterpret_cast<const char*>(&values.front()), values.size() * sizeof(T)); }
+}
+
+template<class T> bool readArray(istream& stream, T* values, size_t count)
+{
+	if (count == 0) { return true; }
+	return !stream.read(reinterpret_cast<char*>(values), count * sizeof(T)).fail();
+}
+
+/** @brief what one level adds to a mesh, read completely before any geometry changes */
+struct LevelData
+{
+	vector<Vec3> vertices[2];
+	vector<Vec3> normals[2];
+	vector<Vec2> texCoords[2];
+	vector<uint32_t> indices;
+};
+
+size_t vertexSize(uint32_t flags)
+{
+	return VERTEX_SIZE + ((flags & PopFileFormat::HAS_NORMALS) ? NORMAL_SIZE : 0) + ((flags & PopFileFormat::HAS_TEXCOORDS) ? TEXCOORD_SIZE : 0);
+}
+
+class CollectLevelOfDetailGeometries : public NodeVisitor
+{
+public:
+	CollectLevelOfDetailGeometries()
+		: NodeVisitor(NodeVisitor::TRAVERSE_ALL_CHILDREN)
+	{
+	}
+
+	virtual void apply(Geode& geode)
+	{
+		for (unsigned int i = 0; i < geode.getNumDrawables(); ++i)
+		{
+			LevelOfDetailGeometry* geometry = dynamic_cast<LevelOfDetailGeometry*>(geode.getDrawable(i));
+			if (geometry) { _geometries.push_back(geometry); }
+		}
+	}
+
+	vector<ref_ptr<LevelOfDetailGeometry> > _geometries;
+};
+
+/**
+ @brief mesh reordered for the file, vertices are sorted by the level that uses them first
+*/
+struct MeshData
+{
+	PopFileFormat::Mesh header;
+	vector<Vec3> vertices[PopFileFormat::NUM_LEVELS][2];
+	vector<Vec3> normals[PopFileFormat::NUM_LEVELS][2];
+	vector<Vec2> texCoords[PopFileFormat::NUM_LEVELS][2];
+	vector<uint32_t> indices[PopFileFormat::NUM_LEVELS];
+};
+
+bool createMeshData(const LevelOfDetailGeometry& geometry, MeshData* mesh)
+{
+	const Vec3Array* vertices = dynamic_cast<const Vec3Array*>(geometry.getVertexArray());
+	if (!vertices) { return false; }
+
+	const Vec3Array* normals = dynamic_cast<const Vec3Array*>(geometry.getNormalArray());
+	if (normals && (normals->getBinding() != Array::BIND_PER_VERTEX || normals->size() != vertices->size())) { normals = NULL; }
+
+	const Vec2Array* texCoords = dynamic_cast<const Vec2Array*>(geometry.getTexCoordArray(0));
+	if (texCoords && texCoords->size() != vertices->size()) { texCoords = NULL; }
+
+	// gather the indices of every level from all lod primitives
+	vector<uint32_t> originalIndices[PopFileFormat::NUM_LEVELS];
+	for (unsigned int i = 0; i < geometry.getNumPrimitiveSets(); ++i)
+	{
+		const PrimitiveSet* primitiveSet = geometry.getPrimitiveSet(i);
+		const LevelOfDetailDrawElements* lodDrawElements = dynamic_cast<const LevelOfDetailDrawElements*>(primitiveSet);
+		if (!lodDrawElements) { continue; }
+
+		vector<GLint> lodRanges = lodDrawElements->getLodRanges();
+		unsigned int start = 0;
+		for (unsigned int k = 0; k < PopFileFormat::NUM_LEVELS; ++k)
+		{
+			unsigned int end = std::min<unsigned int>(lodRanges[k], primitiveSet->getNumIndices());
+			for (unsigned int j = start; j < end; ++j) { originalIndices[k].push_back(primitiveSet->index(j)); }
+			start = std::max(start, end);
+		}
+	}
+
+	// order the vertices by the level that uses them first, unused vertices are dropped
+	unsigned int numProtectedVertices = geometry.getNumberOfProtectedVertices();
+	vector<unsigned int> firstLevel(vertices->size(), UINT_MAX);
+	vector<unsigned int> levelOffset(vertices->size(), 0);
+	memset(&mesh->header, 0, sizeof(mesh->header));
+
+	for (unsigned int k = 0; k < PopFileFormat::NUM_LEVELS; ++k)
+	{
+		for (auto index: originalIndices[k])
+		{
+			if (index >= vertices->size()) { return false; }
+			if (firstLevel[index] != UINT_MAX) { continue; }
+
+			int bucket = (index < numProtectedVertices) ? 0 : 1;
+			firstLevel[index] = k;
+			levelOffset[index] = mesh->vertices[k][bucket].size();
+			mesh->vertices[k][bucket].push_back(vertices->at(index));
+			if (normals) { mesh->normals[k][bucket].push_back(normals->at(index)); }
+			if (texCoords) { mesh->texCoords[k][bucket].push_back(texCoords->at(index)); }
+		}
+	}
+
+	// new index of the first vertex of each level
+	uint32_t protectedStart[PopFileFormat::NUM_LEVELS];
+	uint32_t regularStart[PopFileFormat::NUM_LEVELS];
+	uint32_t numProtected = 0;
+	uint32_t numRegular = 0;
+	for (unsigned int k = 0; k < PopFileFormat::NUM_LEVELS; ++k)
+	{
+		protectedStart[k] = numProtected;
+		regularStart[k] = numRegular;
+		numProtected += mesh->vertices[k][0].size();
+		numRegular += mesh->vertices[k][1].size();
+	}
+
+	for (unsigned int k = 0; k < PopFileFormat::NUM_LEVELS; ++k)
+	{
+		mesh->indices[k].reserve(originalIndices[k].size());
+		for (auto index: originalIndices[k])
+		{
+			unsigned int level = firstLevel[index];
+			uint32_t newIndex = (index < numProtectedVertices) ? protectedStart[level] + levelOffset[index]
+			                                                   : numProtected + regularStart[level] + levelOffset[index];
+			mesh->indices[k].push_back(newIndex);
+		}
+
+		mesh->header.levels[k].numProtectedVertices = mesh->vertices[k][0].size();
+		mesh->header.levels[k].numRegularVertices = mesh->vertices[k][1].size();
+		mesh->header.levels[k].numIndices = mesh->indices[k].size();
+	}
+
+	const BoundingBox& bounds = geometry.getBoundingBox();
+	mesh->header.bounds[0] = bounds.xMin();
+	mesh->header.bounds[1] = bounds.yMin();
+	mesh->header.bounds[2] = bounds.zMin();
+	mesh->header.bounds[3] = bounds.xMax();
+	mesh->header.bounds[4] = bounds.yMax();
+	mesh->header.bounds[5] = bounds.zMax();
+	for (int i = 0; i < 3; ++i)
+	{
+		mesh->header.min[i] = geometry.getMinBounds()[i];
+		mesh->header.max[i] = geometry.getMaxBounds()[i];
+	}
+	const vector<float>& lodErrors = geometry.getLodErrors();
+	for (size_t k = 0; k < lodErrors.size() && k < PopFileFormat::NUM_LEVELS; ++k) { mesh->header.lodErrors[k] = lodErrors[k]; }
+	mesh->header.numProtectedVertices = numProtected;
+	mesh->header.numRegularVertices = numRegular;
+	mesh->header.flags = (normals ? PopFileFormat::HAS_NORMALS : 0) | (texCoords ? PopFileFormat::HAS_TEXCOORDS : 0) |
+	                     (lodErrors.size() == PopFileFormat::NUM_LEVELS ? PopFileFormat::HAS_LOD_ERRORS : 0);
+
+	return true;
+}
+
+void writeMeshHeader(ostream& stream, const PopFileFormat::Mesh& mesh)
+{
+	for (int i = 0; i < 6; ++i) { writeValue(stream, mesh.bounds[i]); }
+	for (int i = 0; i < 3; ++i) { writeValue(stream, mesh.min[i]); }
+	for (int i = 0; i < 3; ++i) { writeValue(stream, mesh.max[i]); }
+	writeValue(stream, mesh.numProtectedVertices);
+	writeValue(stream, mesh.numRegularVertices);
+	writeValue(stream, mesh.flags);
+	for (int k = 0; k < PopFileFormat::NUM_LEVELS; ++k)
+	{
+		writeValue(stream, mesh.levels[k].numProtectedVertices);
+		writeValue(stream, mesh.levels[k].numRegularVertices);
+		writeValue(stream, mesh.levels[k].numIndices);
+	}
+	for (int k = 0; k < PopFileFormat::NUM_LEVELS; ++k) { writeValue(stream, mesh.lodErrors[k]); }
+}
+
+bool readMeshHeader(istream& stream, PopFileFormat::Mesh& mesh)
+{
+	bool valid = true;
+	for (int i = 0; i < 6; ++i) { valid = valid && readValue(stream, mesh.bounds[i]); }
+	for (int i = 0; i < 3; ++i) { valid = valid && readValue(stream, mesh.min[i]); }
+	for (int i = 0; i < 3; ++i) { valid = valid && readValue(stream, mesh.max[i]); }
+	valid = valid && readValue(stream, mesh.numProtectedVertices);
+	valid = valid && readValue(stream, mesh.numRegularVertices);
+	valid = valid && readValue(stream, mesh.flags);
+	for (int k = 0; k < PopFileFormat::NUM_LEVELS; ++k)
+	{
+		valid = valid && readValue(stream, mesh.levels[k].numProtectedVertices);
+		valid = valid && readValue(stream, mesh.levels[k].numRegularVertices);
+		valid = valid && readValue(stream, mesh.levels[k].numIndices);
+	}
+	for (int k = 0; k < PopFileFormat::NUM_LEVELS; ++k) { valid = valid && readValue(stream, mesh.lodErrors[k]); }
+
+	return valid;
+}
+
+/**
+ @brief returns the bounds of the complete mesh, while only some levels are loaded
+*/
+struct FixedBoundingBoxCallback : public Drawable::ComputeBoundingBoxCallback
+{
+	FixedBoundingBoxCallback(const BoundingBox& bounds)
+		: _bounds(bounds)
+	{
+	}
+
+	virtual BoundingBox computeBound(const Drawable&) const { return _bounds; }
+
+	BoundingBox _bounds;
+};
+
+}
+
+bool PopFileWriter::write(const Node& node, const string& fileName) const
+{
+	ofstream stream(fileName.c_str(), ofstream::out | ofstream::binary | ofstream::trunc);
+	if (!stream.is_open()) { return false; }
+
+	return write(node, stream);
+}
+
+bool PopFileWriter::write(const Node& node, ostream& stream) const
+{
+	CollectLevelOfDetailGeometries visitor;
+	const_cast<Node&>(node).accept(visitor);
+
+	vector<MeshData> meshes;
+	meshes.reserve(visitor._geometries.size());
+	for (auto geometry: visitor._geometries)
+	{
+		meshes.push_back(MeshData());
+		if (!createMeshData(*geometry, &meshes.back()))
+		{
+			OSG_WARN << "PopFileWriter: skipped geometry without Vec3Array vertices or lod primitives" << endl;
+			meshes.pop_back();
+		}
+	}
+
+	// the level table points to the data of each level
+	const uint64_t meshHeaderSize = 15 * sizeof(uint32_t) + PopFileFormat::NUM_LEVELS * 4 * sizeof(uint32_t);
+	uint64_t offset = 4 + 3 * sizeof(uint32_t) + (PopFileFormat::NUM_LEVELS + 1) * sizeof(uint64_t) + meshes.size() * meshHeaderSize;
+	vector<uint64_t> levelOffsets;
+	for (unsigned int k = 0; k < PopFileFormat::NUM_LEVELS; ++k)
+	{
+		levelOffsets.push_back(offset);
+		for (auto& mesh: meshes)
+		{
+			const PopFileFormat::Level& level = mesh.header.levels[k];
+			offset += (level.numProtectedVertices + level.numRegularVertices) * vertexSize(mesh.header.flags) + level.numIndices * sizeof(uint32_t);
+		}
+	}
+	levelOffsets.push_back(offset);
+
+	stream.write(PopFileFormat::magic(), 4);
+	writeValue(stream, uint32_t(PopFileFormat::VERSION));
+	writeValue(stream, uint32_t(meshes.size()));
+	writeValue(stream, uint32_t(PopFileFormat::NUM_LEVELS));
+	writeArray(stream, levelOffsets);
+	for (auto& mesh: meshes) { writeMeshHeader(stream, mesh.header); }
+
+	for (unsigned int k = 0; k < PopFileFormat::NUM_LEVELS; ++k)
+	{
+		for (auto& mesh: meshes)
+		{
+			for (int bucket = 0; bucket < 2; ++bucket)
+			{
+				writeArray(stream, mesh.vertices[k][bucket]);
+				writeArray(stream, mesh.normals[k][bucket]);
+				writeArray(stream, mesh.texCoords[k][bucket]);
+			}
+			writeArray(stream, mesh.indices[k]);
+		}
+	}
+
+	return !stream.fail();
+}
+
+PopFileReader::PopFileReader()
+	: _stream(NULL)
+	, _numLevels(0)
+	, _numLoadedLevels(0)
+	, _failed(false)
+{
+}
+
+bool PopFileReader::open(const string& fileName)
+{
+	_fileStream.open(fileName.c_str(), ifstream::in | ifstream::binary);
+	if (!_fileStream.is_open()) { return false; }
+
+	return open(&_fileStream);
+}
+
+bool PopFileReader::open(istream* stream)
+{
+	_stream = stream;
+	_numLoadedLevels = 0;
+	_failed = !readHeader();
+
+	return !_failed;
+}
+
+bool PopFileReader::readHeader()
+{
+	char magic[4];
+	uint32_t version = 0;
+	uint32_t numMeshes = 0;
+	uint32_t numLevels = 0;
+	if (_stream->read(magic, 4).fail() || memcmp(magic, PopFileFormat::magic(), 4) != 0) { return false; }
+	if (!readValue(*_stream, version) || version != PopFileFormat::VERSION) { return false; }
+	if (!readValue(*_stream, numMeshes) || !readValue(*_stream, numLevels) || numLevels != PopFileFormat::NUM_LEVELS) { return false; }
+
+	_numLevels = numLevels;
+	_levelOffsets.resize(numLevels + 1);
+	if (!readArray(*_stream, &_levelOffsets[0], _levelOffsets.size())) { return false; }
+
+	_meshes.resize(numMeshes);
+	for (auto& mesh: _meshes)
+	{
+		if (!readMeshHeader(*_stream, mesh)) { return false; }
+	}
+
+	// create empty geometries, that grow with every level
+	_geode = new Geode();
+	_geometries.clear();
+	_loaded.assign(numMeshes, PopFileFormat::Level());
+	for (auto& mesh: _meshes)
+	{
+		ref_ptr<LevelOfDetailGeometry> geometry = new LevelOfDetailGeometry();
+		geometry->setMinBounds(Vec3(mesh.min[0], mesh.min[1], mesh.min[2]));
+		geometry->setMaxBounds(Vec3(mesh.max[0], mesh.max[1], mesh.max[2]));
+		if (mesh.flags & PopFileFormat::HAS_LOD_ERRORS)
+		{
+			geometry->setLodErrors(vector<float>(mesh.lodErrors, mesh.lodErrors + PopFileFormat::NUM_LEVELS));
+		}
+		geometry->setNumberOfProtectedVertices(mesh.numProtectedVertices);
+		geometry->setMaxLod(0);
+		// the arrays grow in the update traversal while the previous frame may still be drawn
+		geometry->setDataVariance(Object::DYNAMIC);
+		geometry->setComputeBoundingBoxCallback(new FixedBoundingBoxCallback(BoundingBox(mesh.bounds[0], mesh.bounds[1], mesh.bounds[2],
+		                                                                                  mesh.bounds[3], mesh.bounds[4], mesh.bounds[5])));
+
+		geometry->setVertexArray(new Vec3Array());
+		if (mesh.flags & PopFileFormat::HAS_NORMALS) { geometry->setNormalArray(new Vec3Array(), Array::BIND_PER_VERTEX); }
+		if (mesh.flags & PopFileFormat::HAS_TEXCOORDS) { geometry->setTexCoordArray(0, new Vec2Array(), Array::BIND_PER_VERTEX); }
+
+		// use the smallest index type for the vertex count
+		size_t numVertices = mesh.numProtectedVertices + mesh.numRegularVertices;
+		if (numVertices <= UCHAR_MAX) { geometry->addPrimitiveSet(new LevelOfDetailDrawElementsUByte(GL_TRIANGLES)); }
+		else if (numVertices <= USHRT_MAX) { geometry->addPrimitiveSet(new LevelOfDetailDrawElementsUShort(GL_TRIANGLES)); }
+		else { geometry->addPrimitiveSet(new LevelOfDetailDrawElementsUInt(GL_TRIANGLES)); }
+
+		_geometries.push_back(geometry);
+		_geode->addDrawable(geometry);
+	}
+
+	return true;
+}
+
+bool PopFileReader::readNextLevel()
+{
+	if (!_stream || _failed || _numLoadedLevels >= _numLevels) { return false; }
+
+	unsigned int k = _numLoadedLevels;
+
+	// read and validate the level of all meshes first, so a damaged file never leaves a level half applied
+	vector<LevelData> levels(_meshes.size());
+	bool valid = !_stream->seekg(_levelOffsets[k]).fail();
+	for (size_t m = 0; m < _meshes.size() && valid; ++m)
+	{
+		const PopFileFormat::Mesh& mesh = _meshes[m];
+		const PopFileFormat::Level& level = mesh.levels[k];
+		const PopFileFormat::Level& loaded = _loaded[m];
+		LevelData& data = levels[m];
+
+		// both buckets have to stay within the vertex counts of the mesh
+		valid = uint64_t(loaded.numProtectedVertices) + level.numProtectedVertices <= mesh.numProtectedVertices &&
+		        uint64_t(loaded.numRegularVertices) + level.numRegularVertices <= mesh.numRegularVertices;
+
+		size_t counts[2] = { level.numProtectedVertices, level.numRegularVertices };
+		for (int bucket = 0; bucket < 2 && valid; ++bucket)
+		{
+			data.vertices[bucket].resize(counts[bucket]);
+			valid = readArray(*_stream, data.vertices[bucket].data(), counts[bucket]);
+			if (mesh.flags & PopFileFormat::HAS_NORMALS)
+			{
+				data.normals[bucket].resize(counts[bucket]);
+				valid = valid && readArray(*_stream, data.normals[bucket].data(), counts[bucket]);
+			}
+			if (mesh.flags & PopFileFormat::HAS_TEXCOORDS)
+			{
+				data.texCoords[bucket].resize(counts[bucket]);
+				valid = valid && readArray(*_stream, data.texCoords[bucket].data(), counts[bucket]);
+			}
+		}
+
+		size_t numVertices = mesh.numProtectedVertices + loaded.numRegularVertices + level.numRegularVertices;
+		if (valid) { data.indices.resize(level.numIndices); }
+		valid = valid && readArray(*_stream, data.indices.data(), data.indices.size());
+		for (size_t i = 0; i < data.indices.size() && valid; ++i) { valid = data.indices[i] < numVertices; }
+	}
+
+	if (!valid)
+	{
+		// the geometries keep the levels loaded so far, further levels can't be found behind a damaged one
+		OSG_WARN << "PopFileReader: level " << k << " is damaged, no further levels are read" << endl;
+		_failed = true;
+		return false;
+	}
+
+	for (size_t m = 0; m < _meshes.size(); ++m)
+	{
+		const PopFileFormat::Mesh& mesh = _meshes[m];
+		const PopFileFormat::Level& level = mesh.levels[k];
+		PopFileFormat::Level& loaded = _loaded[m];
+		const LevelData& data = levels[m];
+		LevelOfDetailGeometry* geometry = _geometries[m];
+
+		Vec3Array* vertices = static_cast<Vec3Array*>(geometry->getVertexArray());
+		Vec3Array* normals = static_cast<Vec3Array*>(geometry->getNormalArray());
+		Vec2Array* texCoords = static_cast<Vec2Array*>(geometry->getTexCoordArray(0));
+
+		// protected vertices fill the front of the arrays, regular vertices follow all protected ones
+		size_t numVertices = mesh.numProtectedVertices + loaded.numRegularVertices + level.numRegularVertices;
+		vertices->resize(numVertices);
+		if (normals) { normals->resize(numVertices); }
+		if (texCoords) { texCoords->resize(numVertices); }
+
+		size_t starts[2] = { loaded.numProtectedVertices, mesh.numProtectedVertices + loaded.numRegularVertices };
+		for (int bucket = 0; bucket < 2; ++bucket)
+		{
+			copy(data.vertices[bucket].begin(), data.vertices[bucket].end(), vertices->begin() + starts[bucket]);
+			if (normals) { copy(data.normals[bucket].begin(), data.normals[bucket].end(), normals->begin() + starts[bucket]); }
+			if (texCoords) { copy(data.texCoords[bucket].begin(), data.texCoords[bucket].end(), texCoords->begin() + starts[bucket]); }
+		}
+
+		DrawElements* drawElements = geometry->getPrimitiveSet(0)->getDrawElements();
+		LevelOfDetailDrawElements* lodDrawElements = dynamic_cast<LevelOfDetailDrawElements*>(drawElements);
+		drawElements->reserveElements(drawElements->getNumIndices() + data.indices.size());
+		for (auto index: data.indices) { drawElements->addElement(index); }
+
+		// levels that are not loaded yet draw everything loaded so far
+		vector<GLint> lodRanges = lodDrawElements->getLodRanges();
+		vector<GLint> vertexRanges = lodDrawElements->getVertexRanges();
+		vertexRanges.resize(PopFileFormat::NUM_LEVELS, 0);
+		for (unsigned int j = k; j < PopFileFormat::NUM_LEVELS; ++j)
+		{
+			lodRanges[j] = drawElements->getNumIndices();
+			vertexRanges[j] = numVertices;
+		}
+		lodDrawElements->setLodRanges(lodRanges);
+		lodDrawElements->setVertexRanges(vertexRanges);
+
+		loaded.numProtectedVertices += level.numProtectedVertices;
+		loaded.numRegularVertices += level.numRegularVertices;
+		loaded.numIndices += level.numIndices;
+
+		vertices->dirty();
+		if (normals) { normals->dirty(); }
+		if (texCoords) { texCoords->dirty(); }
+		drawElements->dirty();
+		geometry->setMaxLod(k);
+		geometry->dirtyDisplayList();
+	}
+
+	++_numLoadedLevels;
+
+	return true;
+}
+
+void ProgressiveLoadCallback::operator()(Node* node, NodeVisitor* nv)
+{
+	// load one more level per frame if any geometry needs it, a damaged file stops loading
+	if (!_reader->hasFailed() && _reader->getNumLoadedLevels() < _reader->getNumLevels())
+	{
+		Geode* geode = _reader->getGeode();
+		bool needsLevel = _reader->getNumLoadedLevels() == 0;
+		for (unsigned int i = 0; i < geode->getNumDrawables() && !needsLevel; ++i)
+		{
+			LevelOfDetailGeometry* geometry = dynamic_cast<LevelOfDetailGeometry*>(geode->getDrawable(i));
+			needsLevel = geometry && geometry->getRequestedLod() >= _reader->getNumLoadedLevels();
+		}
+
+		if (needsLevel) { _reader->readNextLevel(); }
+	}
+
+	traverse(node, nv);
+}
+
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdint.h>
+
+#include <osg/ref_ptr>
+#include <osg/Node>
+#include <osg/Geode>
+#include <osg/NodeCallback>
+
+#include "LevelOfDetailGeometry.h"
+
+namespace osgUtil
+{
+
+/**
+ @brief Layout of progressive pop buffer files(.pop).
+
+ The header is followed by a level table with the file offset of every level and one table per mesh with the
+ number of vertices and indices each level adds and the measured error of every level. The data is stored level by level, for every mesh a level contains
+ the protected vertices first used by it, the regular vertices first used by it and its indices.
+ Reading the file up to a level gives everything needed to draw all meshes with that level.
+ All values are stored little endian.
+*/
+struct PopFileFormat
+{
+	static const char* magic() { return "POPB"; }
+	enum {
+		VERSION = 2,
+		NUM_LEVELS = 32,
+		HAS_NORMALS = 1,
+		HAS_TEXCOORDS = 2,
+		HAS_LOD_ERRORS = 4
+	};
+
+	struct Level
+	{
+		uint32_t numProtectedVertices;
+		uint32_t numRegularVertices;
+		uint32_t numIndices;
+	};
+
+	struct Mesh
+	{
+		float bounds[6];
+		float min[3];
+		float max[3];
+		uint32_t numProtectedVertices;
+		uint32_t numRegularVertices;
+		uint32_t flags;
+		Level levels[NUM_LEVELS];
+		float lodErrors[NUM_LEVELS];
+	};
+};
+
+/**
+ @brief Writes all pop buffer geometries of a scene graph to a progressive file.
+ Only vertices, per vertex normals and the first texture coordinates are stored, state sets are not written.
+*/
+class OSG_EXPORT PopFileWriter
+{
+public:
+	bool write(const osg::Node& node, const std::string& fileName) const;
+	bool write(const osg::Node& node, std::ostream& stream) const;
+};
+
+/**
+ @brief Reads progressive pop buffer files level by level.
+ After open() the geode holds empty pop buffer geometries, every readNextLevel() adds the vertices and triangles of
+ the next level. Reading must not happen while the geometries are drawn, e.g. call it from an update callback.
+*/
+class OSG_EXPORT PopFileReader : public osg::Referenced
+{
+public:
+	PopFileReader();
+
+	bool open(const std::string& fileName);
+	bool open(std::istream* stream);
+
+	/**
+	 @brief reads the next level of all meshes. The level is validated completely before any geometry changes,
+	 a damaged level leaves all geometries with the levels before it and puts the reader into the failed state.
+	 @return false if all levels are loaded, the file is damaged or the reader failed before
+	*/
+	bool readNextLevel();
+
+	/** @brief the header couldn't be read or a level was damaged, no further levels are read */
+	inline bool hasFailed() const { return _failed; }
+
+	inline unsigned int getNumLoadedLevels() const { return _numLoadedLevels; }
+	inline unsigned int getNumLevels() const { return _numLevels; }
+	inline osg::ref_ptr<osg::Geode> getGeode() const { return _geode; }
+protected:
+	virtual ~PopFileReader() {}
+
+	bool readHeader();
+
+	std::ifstream _fileStream;
+	std::istream* _stream;
+	std::vector<PopFileFormat::Mesh> _meshes;
+	std::vector<uint64_t> _levelOffsets;
+	std::vector<osg::ref_ptr<osg::LevelOfDetailGeometry> > _geometries;
+	std::vector<PopFileFormat::Level> _loaded;
+	osg::ref_ptr<osg::Geode> _geode;
+	unsigned int _numLevels;
+	unsigned int _numLoadedLevels;
+	bool _failed;
+};
+
+/**
+ @brief Update callback that reads the next level of a progressive file as soon as a geometry asks for a finer lod
+ than loaded, so nothing beyond the finest needed level is read.
+*/
+class OSG_EXPORT ProgressiveLoadCallback : public osg::NodeCallback
+{
+public:
+	ProgressiveLoadCallback(osg::ref_ptr<PopFileReader> reader)
+		: _reader(reader)
+	{
+	}
+
+	virtual void operator()(osg::Node* node, osg::NodeVisitor* nv);
+protected:
+	osg::ref_ptr<PopFileReader> _reader;
+};
+
+}
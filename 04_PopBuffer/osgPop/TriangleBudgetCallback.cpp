@@ -0,0 +1,111 @@
+#include "TriangleBudgetCallback.h"
+
+#include <queue>
+#include <algorithm>
+
+#include <osgUtil/CullVisitor>
+
+namespace osg
+{
+
+TriangleBudgetCallback::TriangleBudgetCallback(unsigned int maxTriangles)
+	: _maxTriangles(maxTriangles)
+	, _achievedError(0.0f)
+	, _numTriangles(0)
+{
+}
+
+TriangleBudgetCallback* TriangleBudgetCallback::getTriangleBudget(osgUtil::CullVisitor* cv)
+{
+	return dynamic_cast<TriangleBudgetCallback*>(cv->getUserData());
+}
+
+void TriangleBudgetCallback::operator()(osg::Node* node, osg::NodeVisitor* nv)
+{
+	osgUtil::CullVisitor* cv = dynamic_cast<osgUtil::CullVisitor*>(nv);
+	if (!cv)
+	{
+		traverse(node, nv);
+		return;
+	}
+
+	// the geometries find the budget through the cull visitor while the camera is traversed
+	osg::ref_ptr<osg::Referenced> userData = cv->getUserData();
+	cv->setUserData(this);
+	_candidates.clear();
+	_candidateIndex.clear();
+
+	traverse(node, nv);
+
+	cv->setUserData(userData.get());
+	chooseLods();
+}
+
+void TriangleBudgetCallback::addGeometry(LevelOfDetailGeometry* geometry, float pixelsPerUnit, float maxError)
+{
+	// a geometry below several transforms can only draw one lod, the nearest instance decides
+	auto found = _candidateIndex.find(geometry);
+	if (found != _candidateIndex.end())
+	{
+		Candidate& candidate = _candidates[found->second];
+		candidate.pixelsPerUnit = std::max(candidate.pixelsPerUnit, pixelsPerUnit);
+		candidate.maxError = std::min(candidate.maxError, maxError);
+		return;
+	}
+
+	Candidate candidate = { geometry, pixelsPerUnit, maxError, 0 };
+	_candidateIndex[geometry] = _candidates.size();
+	_candidates.push_back(candidate);
+}
+
+void TriangleBudgetCallback::chooseLods()
+{
+	// every geometry draws at least its coarsest lod, even if that exceeds the budget
+	unsigned int numTriangles = 0;
+	for (auto& candidate: _candidates) { numTriangles += candidate.geometry->getNumTriangles(0); }
+
+	// the next lod of each geometry, ordered by the reduction of the screen space error per additional triangle
+	typedef std::pair<float, size_t> Step;
+	std::priority_queue<Step> steps;
+	auto addStep = [&](size_t i)
+	{
+		const Candidate& candidate = _candidates[i];
+		int maxLod = std::min(candidate.geometry->getMaxLod(), 31);
+		float error = candidate.geometry->getLodError(candidate.lod) * candidate.pixelsPerUnit;
+		if (candidate.lod >= maxLod || error <= candidate.maxError) { return; }
+
+		float nextError = candidate.geometry->getLodError(candidate.lod + 1) * candidate.pixelsPerUnit;
+		unsigned int newTriangles = candidate.geometry->getNumTriangles(candidate.lod + 1) - candidate.geometry->getNumTriangles(candidate.lod);
+		steps.push(Step(std::max(error - nextError, 0.0f) / std::max(newTriangles, 1u), i));
+	};
+
+	for (size_t i = 0; i < _candidates.size(); ++i) { addStep(i); }
+
+	while (!steps.empty())
+	{
+		size_t i = steps.top().second;
+		steps.pop();
+
+		// a geometry whose next lod doesn't fit stays at its lod, cheaper steps of other geometries may still fit
+		Candidate& candidate = _candidates[i];
+		unsigned int newTriangles = candidate.geometry->getNumTriangles(candidate.lod + 1) - candidate.geometry->getNumTriangles(candidate.lod);
+		if (numTriangles + newTriangles > _maxTriangles) { continue; }
+
+		numTriangles += newTriangles;
+		++candidate.lod;
+		addStep(i);
+	}
+
+	// the budget replaces the hysteresis and geomorphing of the geometries
+	float achievedError = 0.0f;
+	for (auto& candidate: _candidates)
+	{
+		achievedError = std::max(achievedError, candidate.geometry->getLodError(candidate.lod) * candidate.pixelsPerUnit);
+		candidate.geometry->setLod(float(candidate.lod));
+	}
+
+	_achievedError = achievedError;
+	_numTriangles = numTriangles;
+}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <osg/NodeCallback>
+
+#include "LevelOfDetailGeometry.h"
+
+namespace osgUtil
+{
+class CullVisitor;
+}
+
+namespace osg
+{
+
+/**
+ @brief Chooses the lods of all pop buffer geometries a camera sees, so that they draw at most a budget of triangles.
+ Set it as cull callback of the camera, one callback per camera. While the camera is traversed, the cull callbacks
+ of the geometries only register the projection of their lod errors. Afterwards every geometry starts with its coarsest lod
+ and the lod step with the largest reduction of the screen space error per additional triangle is taken,
+ until the budget is spent or every geometry is within its maximum view space error.
+ Instanced geometries keep choosing the lods of their instances on their own.
+*/
+class OSG_EXPORT TriangleBudgetCallback : public osg::NodeCallback
+{
+public:
+	TriangleBudgetCallback(unsigned int maxTriangles=5000000u);
+
+	inline void setMaxTriangles(unsigned int maxTriangles) { _maxTriangles = maxTriangles; }
+	inline unsigned int getMaxTriangles() const { return _maxTriangles; }
+
+	/** @brief largest screen space error in pixels of all geometries of the last frame */
+	inline float getAchievedError() const { return _achievedError; }
+
+	/** @brief triangles of the lods chosen in the last frame */
+	inline unsigned int getNumTriangles() const { return _numTriangles; }
+
+	virtual void operator()(osg::Node* node, osg::NodeVisitor* nv);
+
+	/** @brief the budget of the camera that the cull visitor traverses at the moment, or NULL */
+	static TriangleBudgetCallback* getTriangleBudget(osgUtil::CullVisitor* cv);
+
+	/**
+	 @brief registers a visible geometry, the lod is set after the camera is traversed
+	 @param pixelsPerUnit projection of the object space errors, see LevelOfDetailGeometry::computePixelsPerUnit()
+	 @param maxError screen space error in pixels that is good enough for this geometry
+	*/
+	void addGeometry(LevelOfDetailGeometry* geometry, float pixelsPerUnit, float maxError);
+protected:
+	virtual ~TriangleBudgetCallback() {}
+
+	void chooseLods();
+
+	struct Candidate
+	{
+		LevelOfDetailGeometry* geometry;
+		float pixelsPerUnit;
+		float maxError;
+		int lod;
+	};
+
+	unsigned int _maxTriangles;
+	float _achievedError;
+	unsigned int _numTriangles;
+	std::vector<Candidate> _candidates;
+	std::unordered_map<LevelOfDetailGeometry*, size_t> _candidateIndex;
+};
+
+}
@@ -1,5 +1,11 @@
 #pragma once
 
+// std
+#include <cmath>
+
+// osg
+#include <osg/Vec3>
+
 namespace osgUtil
 {
 
@@ -51,24 +57,53 @@ protected:
 
 
 /**
- @brief quantizes vertex position with different bit precissions(used for vertex clustering)
+ @brief factors that map positions between min and max to integers with the given bit precission, one per axis
+*/
+inline osg::Vec3 quantizationFactor(int bits, const osg::Vec3& min, const osg::Vec3& max)
+{
+	float numCells = pow(2.0f, bits) - 1.0f;
+	return osg::Vec3(numCells / (max.x()-min.x()), numCells / (max.y()-min.y()), numCells / (max.z()-min.z()));
+}
+
+/**
+ @brief factors that map quantized integers back to positions, one per axis
+*/
+inline osg::Vec3 dequantizationFactor(int bits, const osg::Vec3& min, const osg::Vec3& max)
+{
+	return (max-min) / pow(2.0f, bits);
+}
+
+/**
+ @brief quantizes vertex position with precomputed quantization factors
 */
-template<class Vector> Vec3ui quantize(int bits, float min, float max, const Vector& vertex)
+template<class Vector> Vec3ui quantize(const osg::Vec3& factor, const osg::Vec3& min, const Vector& vertex)
 {
-	float factor = (pow(2.0f, bits) - 1.0f) / (max-min);
+	return Vec3ui(	static_cast<unsigned int>(factor.x() * (vertex.x() - min.x()) + 0.5f),
+					static_cast<unsigned int>(factor.y() * (vertex.y() - min.y()) + 0.5f),
+					static_cast<unsigned int>(factor.z() * (vertex.z() - min.z()) + 0.5f));
+}
 
-	return Vec3ui(	unsigned int(factor * (vertex.x() - min) + 0.5f),
-					unsigned int(factor * (vertex.y() - min) + 0.5f),
-					unsigned int(factor * (vertex.z() - min) + 0.5f));
+/**
+ @brief dequantizes vertex position with precomputed dequantization factors
+*/
+template<class Vector> Vector dequantize(const osg::Vec3& invFactor, const osg::Vec3& min, const Vec3ui& vertex)
+{
+	return Vector(  invFactor.x() * vertex.x() + min.x(),
+					invFactor.y() * vertex.y() + min.y(),
+					invFactor.z() * vertex.z() + min.z());
 }
 
-template<class Vector> Vector dequantize(int bits, float min, float max, const Vec3ui& vertex)
+/**
+ @brief quantizes vertex position with different bit precissions(used for vertex clustering)
+*/
+template<class Vector> Vec3ui quantize(int bits, const osg::Vec3& min, const osg::Vec3& max, const Vector& vertex)
 {
-	float invFactor = (max-min)/pow(2.0f, bits);
+	return quantize(quantizationFactor(bits, min, max), min, vertex);
+}
 
-	return Vector(  invFactor * vertex.x() + min,
-					invFactor * vertex.y() + min,
-					invFactor * vertex.z() + min);
+template<class Vector> Vector dequantize(int bits, const osg::Vec3& min, const osg::Vec3& max, const Vec3ui& vertex)
+{
+	return dequantize<Vector>(dequantizationFactor(bits, min, max), min, vertex);
 }
 
 }
\ No newline at end of file
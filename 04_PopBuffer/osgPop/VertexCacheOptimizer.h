@@ -0,0 +1,140 @@
+#pragma once
+
+// std
+#include <vector>
+#include <algorithm>
+
+namespace osgUtil
+{
+
+/**
+ @brief average number of post transform cache misses per triangle (ACMR) of a triangle list,
+ simulated with a FIFO cache of cacheSize entries. 0.5 is the optimum for large regular meshes, 3 the worst case.
+*/
+template<class Index> float computeAcmr(const Index* indices, size_t numIndices, unsigned int cacheSize=16u)
+{
+	if (numIndices < 3) { return 0.0f; }
+
+	// the vertices of the bucket are compacted first, so the cache timestamps need no array of the whole vertex buffer
+	std::vector<Index> vertices(indices, indices + numIndices);
+	std::sort(vertices.begin(), vertices.end());
+	vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+	// a vertex is in the FIFO cache if it was loaded less than cacheSize misses ago
+	std::vector<size_t> loadTime(vertices.size(), 0);
+	size_t misses = 0;
+	for (size_t i = 0; i < numIndices; ++i)
+	{
+		size_t v = std::lower_bound(vertices.begin(), vertices.end(), indices[i]) - vertices.begin();
+		if (loadTime[v] == 0 || misses - loadTime[v] >= cacheSize)
+		{
+			++misses;
+			loadTime[v] = misses;
+		}
+	}
+
+	return float(misses) / float(numIndices / 3);
+}
+
+/**
+ @brief reorders the triangles of a list for the post transform vertex cache with Tipsify
+ (Sander, Nehab and Barczak, Fast Triangle Reordering for Vertex Locality and Reduced Overdraw, 2007).
+ Only the order of the triangles changes, every triangle keeps its vertices and their winding.
+*/
+template<class Index> void optimizeVertexCache(Index* indices, size_t numIndices, unsigned int cacheSize=16u)
+{
+	size_t numTriangles = numIndices / 3;
+	if (numTriangles < 2) { return; }
+
+	// compact the vertices of the list to local IDs
+	std::vector<Index> vertices(indices, indices + 3 * numTriangles);
+	std::sort(vertices.begin(), vertices.end());
+	vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+	size_t numVertices = vertices.size();
+
+	std::vector<unsigned int> localIndices(3 * numTriangles);
+	for (size_t i = 0; i < localIndices.size(); ++i)
+	{
+		localIndices[i] = std::lower_bound(vertices.begin(), vertices.end(), indices[i]) - vertices.begin();
+	}
+
+	// triangles adjacent to every vertex, stored in one array with an offset per vertex
+	std::vector<unsigned int> adjacencyOffset(numVertices + 1, 0);
+	for (auto v: localIndices) { ++adjacencyOffset[v + 1]; }
+	for (size_t v = 1; v <= numVertices; ++v) { adjacencyOffset[v] += adjacencyOffset[v - 1]; }
+	std::vector<unsigned int> adjacency(localIndices.size());
+	{
+		std::vector<unsigned int> next(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (size_t i = 0; i < localIndices.size(); ++i) { adjacency[next[localIndices[i]]++] = i / 3; }
+	}
+
+	std::vector<unsigned int> liveTriangles(numVertices);
+	for (size_t v = 0; v < numVertices; ++v) { liveTriangles[v] = adjacencyOffset[v + 1] - adjacencyOffset[v]; }
+
+	std::vector<unsigned int> cacheTime(numVertices, 0);
+	std::vector<unsigned char> emitted(numTriangles, 0);
+	std::vector<unsigned int> deadEnd;
+	std::vector<unsigned int> candidates;
+	std::vector<Index> output;
+	output.reserve(3 * numTriangles);
+
+	const unsigned int none = ~0u;
+	unsigned int time = cacheSize + 1;
+	unsigned int cursor = 0;
+	unsigned int fanning = localIndices[0];
+
+	while (fanning != none)
+	{
+		// emit all remaining triangles around the fanning vertex
+		candidates.clear();
+		for (unsigned int a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning + 1]; ++a)
+		{
+			unsigned int t = adjacency[a];
+			if (emitted[t]) { continue; }
+
+			for (int j = 0; j < 3; ++j)
+			{
+				unsigned int v = localIndices[3 * t + j];
+				output.push_back(indices[3 * t + j]);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				--liveTriangles[v];
+				if (time - cacheTime[v] > cacheSize) { cacheTime[v] = time++; }
+			}
+			emitted[t] = 1;
+		}
+
+		// continue with the candidate that stays longest in the cache after its remaining triangles are emitted
+		fanning = none;
+		int bestPriority = -1;
+		for (auto v: candidates)
+		{
+			if (liveTriangles[v] == 0) { continue; }
+
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) { priority = time - cacheTime[v]; }
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				fanning = v;
+			}
+		}
+
+		// dead end, take the latest vertex with triangles left, or the first vertex with triangles left
+		while (fanning == none && !deadEnd.empty())
+		{
+			unsigned int v = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[v] > 0) { fanning = v; }
+		}
+		while (fanning == none && cursor < numVertices)
+		{
+			if (liveTriangles[cursor] > 0) { fanning = cursor; }
+			++cursor;
+		}
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+}
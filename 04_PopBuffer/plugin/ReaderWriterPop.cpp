@@ -0,0 +1,109 @@
+#include "PopFile.h"
+
+#include <sstream>
+
+#include <osg/Group>
+#include <osgDB/ReaderWriter>
+#include <osgDB/Registry>
+#include <osgDB/FileNameUtils>
+#include <osgDB/FileUtils>
+
+/**
+ @brief Reads and writes progressive pop buffer files.
+ Options: "progressive" reads the levels on demand while the model is drawn, "maxLevel <n>" stops reading after level n.
+*/
+class ReaderWriterPop : public osgDB::ReaderWriter
+{
+public:
+    ReaderWriterPop()
+    {
+        supportsExtension("pop", "Progressive pop buffer format");
+        supportsOption("progressive", "Read levels on demand, when the camera needs them");
+        supportsOption("maxLevel <n>", "Don't read levels finer than n");
+    }
+
+    virtual const char* className() const { return "Progressive pop buffer reader/writer"; }
+
+    virtual ReadResult readNode(const std::string& file, const osgDB::ReaderWriter::Options* options) const
+    {
+        std::string ext = osgDB::getLowerCaseFileExtension(file);
+        if (!acceptsExtension(ext)) { return ReadResult::FILE_NOT_HANDLED; }
+
+        std::string fileName = osgDB::findDataFile(file, options);
+        if (fileName.empty()) { return ReadResult::FILE_NOT_FOUND; }
+
+        osg::ref_ptr<osgUtil::PopFileReader> reader = new osgUtil::PopFileReader();
+        if (!reader->open(fileName)) { return ReadResult::ERROR_IN_READING_FILE; }
+
+        if (hasOption(options, "progressive"))
+        {
+            // the callback keeps the reader and its file open
+            osg::ref_ptr<osg::Group> group = new osg::Group();
+            group->addChild(reader->getGeode());
+            group->setUpdateCallback(new osgUtil::ProgressiveLoadCallback(reader));
+
+            return group.release();
+        }
+
+        return readLevels(reader, options);
+    }
+
+    virtual ReadResult readNode(std::istream& stream, const osgDB::ReaderWriter::Options* options) const
+    {
+        osg::ref_ptr<osgUtil::PopFileReader> reader = new osgUtil::PopFileReader();
+        if (!reader->open(&stream)) { return ReadResult::ERROR_IN_READING_FILE; }
+
+        return readLevels(reader, options);
+    }
+
+    virtual WriteResult writeNode(const osg::Node& node, const std::string& fileName, const osgDB::ReaderWriter::Options* options) const
+    {
+        std::string ext = osgDB::getLowerCaseFileExtension(fileName);
+        if (!acceptsExtension(ext)) { return WriteResult::FILE_NOT_HANDLED; }
+
+        osgUtil::PopFileWriter writer;
+        return writer.write(node, fileName) ? WriteResult::FILE_SAVED : WriteResult::ERROR_IN_WRITING_FILE;
+    }
+
+    virtual WriteResult writeNode(const osg::Node& node, std::ostream& stream, const osgDB::ReaderWriter::Options* options) const
+    {
+        osgUtil::PopFileWriter writer;
+        return writer.write(node, stream) ? WriteResult::FILE_SAVED : WriteResult::ERROR_IN_WRITING_FILE;
+    }
+private:
+    ReadResult readLevels(osg::ref_ptr<osgUtil::PopFileReader> reader, const osgDB::ReaderWriter::Options* options) const
+    {
+        unsigned int maxLevel = reader->getNumLevels() - 1;
+        if (options)
+        {
+            std::istringstream optionStream(options->getOptionString());
+            std::string option;
+            while (optionStream >> option)
+            {
+                if (option == "maxLevel") { optionStream >> maxLevel; }
+            }
+        }
+
+        while (reader->getNumLoadedLevels() <= maxLevel && reader->readNextLevel()) {}
+
+        if (reader->getNumLoadedLevels() == 0) { return ReadResult::ERROR_IN_READING_FILE; }
+
+        return reader->getGeode().release();
+    }
+
+    bool hasOption(const osgDB::ReaderWriter::Options* options, const std::string& name) const
+    {
+        if (!options) { return false; }
+
+        std::istringstream optionStream(options->getOptionString());
+        std::string option;
+        while (optionStream >> option)
+        {
+            if (option == name) { return true; }
+        }
+
+        return false;
+    }
+};
+
+REGISTER_OSGPLUGIN(pop, ReaderWriterPop)
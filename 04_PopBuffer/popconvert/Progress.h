@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <ostream>
+#include <stdint.h>
+
+#include <osg/Timer>
+
+namespace osgExample {
+
+/**
+ @brief Prints the progress and throughput of a long running step on a single console line
+*/
+class Progress
+{
+public:
+    Progress(std::ostream& out, const std::string& name, uint64_t total, const std::string& unit)
+        : m_out(out)
+        , m_name(name)
+        , m_unit(unit)
+        , m_total(total)
+        , m_done(0)
+        , m_start(osg::Timer::instance()->tick())
+        , m_lastPrint(m_start)
+    {
+    }
+
+    /**
+     @brief adds finished work and prints the progress at most ten times per second
+    */
+    void advance(uint64_t amount)
+    {
+        m_done += amount;
+
+        osg::Timer_t now = osg::Timer::instance()->tick();
+        if (osg::Timer::instance()->delta_s(m_lastPrint, now) > 0.1 || m_done >= m_total)
+        {
+            print(now);
+            m_lastPrint = now;
+        }
+    }
+
+    void finish()
+    {
+        print(osg::Timer::instance()->tick());
+        m_out << std::endl;
+    }
+
+    inline double getElapsedSeconds() const { return osg::Timer::instance()->delta_s(m_start, osg::Timer::instance()->tick()); }
+private:
+    void print(osg::Timer_t now)
+    {
+        double seconds = osg::Timer::instance()->delta_s(m_start, now);
+        double percent = (m_total > 0) ? 100.0 * m_done / m_total : 100.0;
+        double throughput = (seconds > 0.0) ? m_done / seconds : 0.0;
+
+        m_out << "\r" << m_name << ": " << (int)percent << "% (" << m_done << "/" << m_total << " " << m_unit << ", "
+              << (uint64_t)throughput << " " << m_unit << "/s, " << (int)seconds << "s)" << std::flush;
+    }
+
+    std::ostream& m_out;
+    std::string m_name;
+    std::string m_unit;
+    uint64_t m_total;
+    uint64_t m_done;
+    osg::Timer_t m_start;
+    osg::Timer_t m_lastPrint;
+};
+
+}
@@ -0,0 +1,218 @@
+#include "StreamingConverter.h"
+#include "Progress.h"
+#include "ConvertToLevelOfDetailGeometryVisitor.h"
+#include "HashMap.h"
+
+#include <cstdio>
+#include <sstream>
+#include <memory>
+
+#include <osg/Geode>
+#include <osg/Group>
+#include <osg/ProxyNode>
+#include <osgUtil/SmoothingVisitor>
+#include <osgDB/WriteFile>
+#include <osgDB/FileNameUtils>
+
+namespace osgExample {
+
+// number of triangles read from disk at once
+static const size_t READ_CHUNK_SIZE = 65536;
+
+// stops splitting buckets whose triangles are too close to be separated
+static const unsigned int MAX_DEPTH = 24;
+
+bool StreamingConverter::convert(const std::string& inputFile, const std::string& outputFile)
+{
+    // first pass: count triangles and compute the bounds of their centers
+    Bucket root;
+    root.fileName = inputFile;
+    root.format = TriangleReader::STL;
+    root.depth = 0;
+    {
+        TriangleReader reader(inputFile, TriangleReader::STL);
+        if (!reader.isValid())
+        {
+            m_out << "Can't read binary stl file " << inputFile << std::endl;
+            return false;
+        }
+
+        root.numTriangles = reader.getNumTriangles();
+
+        Progress progress(m_out, "Scanning", reader.getNumBytes(), "bytes");
+        std::vector<Triangle> triangles;
+        uint64_t numBytesRead = 0;
+        while (reader.read(triangles, READ_CHUNK_SIZE) > 0)
+        {
+            for (auto triangle: triangles) { root.centerBounds.expandBy(triangle.center()); }
+            progress.advance(reader.getNumBytesRead() - numBytesRead);
+            numBytesRead = reader.getNumBytesRead();
+        }
+        progress.finish();
+    }
+
+    // split buckets until every leaf is small enough
+    std::vector<Bucket> pendingBuckets(1, root);
+    std::vector<Bucket> leaves;
+    unsigned int bucketCounter = 0;
+    osg::Timer_t partitionStart = osg::Timer::instance()->tick();
+
+    while (!pendingBuckets.empty())
+    {
+        Bucket bucket = pendingBuckets.back();
+        pendingBuckets.pop_back();
+
+        // buckets whose triangles share the same center can't be split any further
+        osg::Vec3 extent = bucket.centerBounds._max - bucket.centerBounds._min;
+        bool splittable = extent.x() > 0.0f || extent.y() > 0.0f || extent.z() > 0.0f;
+
+        if (bucket.numTriangles <= m_maxLeafTriangles || bucket.depth >= MAX_DEPTH || !splittable)
+        {
+            leaves.push_back(bucket);
+            continue;
+        }
+
+        std::vector<Bucket> children = partition(bucket, outputFile, &bucketCounter);
+        pendingBuckets.insert(pendingBuckets.end(), children.begin(), children.end());
+
+        // the input file is kept, temporary buckets are removed as soon as they are split
+        if (bucket.format == TriangleReader::RAW) { remove(bucket.fileName.c_str()); }
+    }
+
+    double partitionSeconds = osg::Timer::instance()->delta_s(partitionStart, osg::Timer::instance()->tick());
+    m_out << "Partitioned " << root.numTriangles << " triangles into " << leaves.size() << " leaves in " << partitionSeconds << "s" << std::endl;
+
+    // convert every leaf on its own and reference it from the output file
+    osg::ref_ptr<osg::Group> group = new osg::Group();
+    std::string directory = osgDB::getFilePath(outputFile);
+    std::string baseName = osgDB::getStrippedName(outputFile);
+    std::string extension = osgDB::getFileExtensionIncludingDot(outputFile);
+
+    Progress progress(m_out, "Converting", root.numTriangles, "triangles");
+    for (size_t i = 0; i < leaves.size(); ++i)
+    {
+        osg::ref_ptr<osg::Node> node = convertLeaf(leaves[i]);
+        if (leaves[i].format == TriangleReader::RAW) { remove(leaves[i].fileName.c_str()); }
+        if (!node) { continue; }
+
+        std::stringstream leafName;
+        leafName << baseName << "_" << i << extension;
+        if (!osgDB::writeNodeFile(*node, osgDB::concatPaths(directory, leafName.str())))
+        {
+            m_out << std::endl << "Can't write " << leafName.str() << std::endl;
+
+            // the buckets of the remaining leaves are temporary files as well
+            for (size_t j = i + 1; j < leaves.size(); ++j)
+            {
+                if (leaves[j].format == TriangleReader::RAW) { remove(leaves[j].fileName.c_str()); }
+            }
+            return false;
+        }
+
+        // the proxy keeps the bounds of the leaf, so it can be culled without loading,
+        // the database pager loads the leaf in the background once it is visited
+        osg::ref_ptr<osg::ProxyNode> proxy = new osg::ProxyNode();
+        proxy->setLoadingExternalReferenceMode(osg::ProxyNode::DEFER_LOADING_TO_DATABASE_PAGER);
+        proxy->setFileName(0, leafName.str());
+        proxy->setCenterMode(osg::ProxyNode::USER_DEFINED_CENTER);
+        proxy->setCenter(node->getBound().center());
+        proxy->setRadius(node->getBound().radius());
+        group->addChild(proxy);
+
+        progress.advance(leaves[i].numTriangles);
+    }
+    progress.finish();
+
+    return osgDB::writeNodeFile(*group, outputFile);
+}
+
+std::vector<StreamingConverter::Bucket> StreamingConverter::partition(const Bucket& bucket, const std::string& outputFile, unsigned int* bucketCounter)
+{
+    osg::Vec3 center = bucket.centerBounds.center();
+
+    // one writer per octant, each only buffers a few triangles in memory
+    std::vector<std::shared_ptr<TriangleWriter> > writers;
+    for (int i = 0; i < 8; ++i)
+    {
+        std::stringstream fileName;
+        fileName << outputFile << ".bucket" << (*bucketCounter)++ << ".tmp";
+        writers.push_back(std::make_shared<TriangleWriter>(fileName.str()));
+    }
+
+    TriangleReader reader(bucket.fileName, bucket.format);
+    std::vector<Triangle> triangles;
+    while (reader.read(triangles, READ_CHUNK_SIZE) > 0)
+    {
+        for (auto triangle: triangles)
+        {
+            osg::Vec3 triangleCenter = triangle.center();
+            int octant = (triangleCenter.x() > center.x() ? 1 : 0) |
+                         (triangleCenter.y() > center.y() ? 2 : 0) |
+                         (triangleCenter.z() > center.z() ? 4 : 0);
+            writers[octant]->write(triangle);
+        }
+    }
+
+    std::vector<Bucket> children;
+    for (auto writer: writers)
+    {
+        writer->close();
+
+        if (writer->getNumTriangles() == 0)
+        {
+            remove(writer->getFileName().c_str());
+            continue;
+        }
+
+        Bucket child;
+        child.fileName = writer->getFileName();
+        child.format = TriangleReader::RAW;
+        child.numTriangles = writer->getNumTriangles();
+        child.centerBounds = writer->getCenterBounds();
+        child.depth = bucket.depth + 1;
+        children.push_back(child);
+    }
+
+    return children;
+}
+
+osg::ref_ptr<osg::Node> StreamingConverter::convertLeaf(const Bucket& leaf)
+{
+    TriangleReader reader(leaf.fileName, leaf.format);
+    std::vector<Triangle> triangles;
+    reader.read(triangles, (size_t)leaf.numTriangles);
+    if (triangles.empty()) { return NULL; }
+
+    // weld vertices, triangle soups store every vertex once per triangle
+    osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array();
+    osg::ref_ptr<osg::DrawElementsUInt> drawElements = new osg::DrawElementsUInt(GL_TRIANGLES);
+    drawElements->reserve(triangles.size() * 3);
+    osgUtil::HashMap<osg::Vec3, unsigned int, osgUtil::VectorHash<osg::Vec3> > vertexIDMap(triangles.size() / 2);
+
+    for (auto triangle: triangles)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            std::pair<unsigned int*, bool> vertexID = vertexIDMap.insert(triangle.vertices[j], vertices->size());
+            if (vertexID.second) { vertices->push_back(triangle.vertices[j]); }
+            drawElements->push_back(*vertexID.first);
+        }
+    }
+    triangles.clear();
+
+    osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry();
+    geometry->setVertexArray(vertices);
+    geometry->addPrimitiveSet(drawElements);
+    osgUtil::SmoothingVisitor::smooth(*geometry);
+
+    osgUtil::ConvertToLevelOfDetailGeometryVisitor lodVisitor;
+    osg::ref_ptr<osg::Geometry> lodGeometry = lodVisitor.convert(geometry);
+    if (!lodGeometry) { return NULL; }
+
+    osg::ref_ptr<osg::Geode> geode = new osg::Geode();
+    geode->addDrawable(lodGeometry);
+
+    return geode;
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <stdint.h>
+
+#include <osg/ref_ptr>
+#include <osg/Node>
+#include <osg/BoundingBox>
+
+#include "TriangleStream.h"
+
+namespace osgExample {
+
+/**
+ @brief Converts triangle soups, that don't fit into the main memory, to pop buffers.
+ The triangles are streamed from disk and split into octree buckets on disk, until each bucket has at most maxLeafTriangles triangles.
+ Every leaf bucket is then loaded, converted and written on its own, so the memory usage depends on the leaf size only.
+ The output file references the converted leaf files with proxy nodes.
+*/
+class StreamingConverter
+{
+public:
+    StreamingConverter(uint64_t maxLeafTriangles, std::ostream& out)
+        : m_maxLeafTriangles(maxLeafTriangles)
+        , m_out(out)
+    {
+    }
+
+    /**
+     @brief converts a binary stl file
+     @return false if the input can't be read or the output can't be written
+    */
+    bool convert(const std::string& inputFile, const std::string& outputFile);
+private:
+    struct Bucket
+    {
+        std::string fileName;
+        TriangleReader::Format format;
+        uint64_t numTriangles;
+        osg::BoundingBox centerBounds;
+        unsigned int depth;
+    };
+
+    /**
+     @brief distributes the triangles of a bucket to the eight octants of its bounds
+    */
+    std::vector<Bucket> partition(const Bucket& bucket, const std::string& outputFile, unsigned int* bucketCounter);
+
+    /**
+     @brief loads a leaf bucket, welds its vertices and converts it to a pop buffer geometry
+    */
+    osg::ref_ptr<osg::Node> convertLeaf(const Bucket& leaf);
+
+    uint64_t m_maxLeafTriangles;
+    std::ostream& m_out;
+};
+
+}
@@ -0,0 +1,113 @@
+#include "TriangleStream.h"
+
+#include <cstring>
+#include <algorithm>
+
+namespace osgExample {
+
+// binary stl: 80 byte header, triangle count, then normal, three vertices and attribute per triangle
+static const size_t STL_HEADER_SIZE = 84;
+static const size_t STL_TRIANGLE_SIZE = 50;
+static const size_t RAW_TRIANGLE_SIZE = sizeof(float) * 9;
+
+// number of triangles a writer keeps in memory
+static const size_t WRITE_BUFFER_SIZE = 16384;
+
+TriangleReader::TriangleReader(const std::string& fileName, Format format)
+    : m_stream(fileName.c_str(), std::ifstream::in | std::ifstream::binary)
+    , m_format(format)
+    , m_valid(false)
+    , m_numTriangles(0)
+    , m_numTrianglesRead(0)
+    , m_numBytes(0)
+    , m_numBytesRead(0)
+{
+    if (!m_stream.is_open()) { return; }
+
+    m_stream.seekg(0, std::ifstream::end);
+    m_numBytes = m_stream.tellg();
+    m_stream.seekg(0, std::ifstream::beg);
+
+    if (m_format == STL)
+    {
+        char header[STL_HEADER_SIZE];
+        if (!m_stream.read(header, STL_HEADER_SIZE)) { return; }
+
+        uint32_t numTriangles = 0;
+        memcpy(&numTriangles, header + 80, sizeof(numTriangles));
+        m_numTriangles = numTriangles;
+        m_numBytesRead = STL_HEADER_SIZE;
+
+        // ascii stl files and truncated files don't match the announced size
+        if (m_numBytes != STL_HEADER_SIZE + m_numTriangles * STL_TRIANGLE_SIZE) { return; }
+    } else {
+        m_numTriangles = m_numBytes / RAW_TRIANGLE_SIZE;
+    }
+
+    m_valid = true;
+}
+
+size_t TriangleReader::read(std::vector<Triangle>& triangles, size_t maxTriangles)
+{
+    triangles.clear();
+    if (!m_valid) { return 0; }
+
+    size_t numTriangles = (size_t)std::min<uint64_t>(maxTriangles, m_numTriangles - m_numTrianglesRead);
+    size_t triangleSize = (m_format == STL) ? STL_TRIANGLE_SIZE : RAW_TRIANGLE_SIZE;
+    size_t vertexOffset = (m_format == STL) ? 3 * sizeof(float) : 0;
+
+    m_buffer.resize(numTriangles * triangleSize);
+    if (numTriangles == 0 || !m_stream.read(&m_buffer[0], m_buffer.size())) { return 0; }
+
+    triangles.resize(numTriangles);
+    for (size_t i = 0; i < numTriangles; ++i)
+    {
+        const char* data = &m_buffer[i * triangleSize + vertexOffset];
+        for (int j = 0; j < 3; ++j)
+        {
+            memcpy(triangles[i].vertices[j].ptr(), data + j * 3 * sizeof(float), 3 * sizeof(float));
+        }
+    }
+
+    m_numTrianglesRead += numTriangles;
+    m_numBytesRead += m_buffer.size();
+
+    return numTriangles;
+}
+
+TriangleWriter::TriangleWriter(const std::string& fileName)
+    : m_fileName(fileName)
+    , m_stream(fileName.c_str(), std::ofstream::out | std::ofstream::binary | std::ofstream::trunc)
+    , m_numTriangles(0)
+{
+    m_buffer.reserve(WRITE_BUFFER_SIZE);
+}
+
+void TriangleWriter::write(const Triangle& triangle)
+{
+    m_buffer.push_back(triangle);
+    m_centerBounds.expandBy(triangle.center());
+    ++m_numTriangles;
+
+    if (m_buffer.size() >= WRITE_BUFFER_SIZE) { flush(); }
+}
+
+void TriangleWriter::flush()
+{
+    for (auto triangle: m_buffer)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            m_stream.write(reinterpret_cast<const char*>(triangle.vertices[j].ptr()), 3 * sizeof(float));
+        }
+    }
+    m_buffer.clear();
+}
+
+void TriangleWriter::close()
+{
+    flush();
+    m_stream.close();
+}
+
+}
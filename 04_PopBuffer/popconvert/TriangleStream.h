@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdint.h>
+
+#include <osg/Vec3>
+#include <osg/BoundingBox>
+
+namespace osgExample {
+
+/**
+ @brief Triangle of a triangle soup, that is streamed from or to disk
+*/
+struct Triangle
+{
+    osg::Vec3 vertices[3];
+
+    inline osg::Vec3 center() const { return (vertices[0] + vertices[1] + vertices[2]) / 3.0f; }
+};
+
+/**
+ @brief Reads triangles of a file in chunks, so that files larger than the main memory can be processed.
+ Supports binary stl files and the raw bucket files written by TriangleWriter.
+*/
+class TriangleReader
+{
+public:
+    enum Format {
+        STL = 0,
+        RAW = 1
+    };
+
+    TriangleReader(const std::string& fileName, Format format);
+
+    /**
+     @brief reads up to maxTriangles triangles into triangles
+     @return number of read triangles, 0 at the end of the file
+    */
+    size_t read(std::vector<Triangle>& triangles, size_t maxTriangles);
+
+    inline bool isValid() const { return m_valid; }
+    inline uint64_t getNumTriangles() const { return m_numTriangles; }
+    inline uint64_t getNumBytes() const { return m_numBytes; }
+    inline uint64_t getNumBytesRead() const { return m_numBytesRead; }
+private:
+    std::ifstream m_stream;
+    Format m_format;
+    bool m_valid;
+    uint64_t m_numTriangles;
+    uint64_t m_numTrianglesRead;
+    uint64_t m_numBytes;
+    uint64_t m_numBytesRead;
+    std::vector<char> m_buffer;
+};
+
+/**
+ @brief Appends triangles to a raw bucket file
+*/
+class TriangleWriter
+{
+public:
+    TriangleWriter(const std::string& fileName);
+
+    void write(const Triangle& triangle);
+
+    /**
+     @brief writes the buffered triangles to disk and closes the file
+    */
+    void close();
+
+    inline uint64_t getNumTriangles() const { return m_numTriangles; }
+    inline const osg::BoundingBox& getCenterBounds() const { return m_centerBounds; }
+    inline const std::string& getFileName() const { return m_fileName; }
+private:
+    void flush();
+
+    std::string m_fileName;
+    std::ofstream m_stream;
+    std::vector<Triangle> m_buffer;
+    uint64_t m_numTriangles;
+    osg::BoundingBox m_centerBounds;
+};
+
+}
@@ -0,0 +1,27 @@
+#include "StreamingConverter.h"
+
+#include <iostream>
+#include <algorithm>
+
+#include <osg/ArgumentParser>
+
+int main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc, argv);
+    arguments.getApplicationUsage()->setApplicationName(arguments.getApplicationName());
+    arguments.getApplicationUsage()->setCommandLineUsage(arguments.getApplicationName() + " [options] input.stl output.osgb");
+    arguments.getApplicationUsage()->addCommandLineOption("--leaf-triangles <n>", "Maximum number of triangles converted at once (default 1000000)");
+
+    if (arguments.read("-h") || arguments.read("--help") || arguments.argc() < 3)
+    {
+        arguments.getApplicationUsage()->write(std::cout);
+        return 1;
+    }
+
+    unsigned int maxLeafTriangles = 1000000;
+    arguments.read("--leaf-triangles", maxLeafTriangles);
+
+    osgExample::StreamingConverter converter(std::max(1u, maxLeafTriangles), std::cout);
+
+    return converter.convert(arguments[1], arguments[2]) ? 0 : -1;
+}
@@ -0,0 +1,426 @@
+#include "LevelOfDetailGeometry.h"
+#include "LevelOfDetailDrawElements.h"
+
+#include <cstring>
+#include <vector>
+
+#include <osgDB/ObjectWrapper>
+#include <osgDB/InputStream>
+#include <osgDB/OutputStream>
+
+#ifdef OSGPOP_USE_LZ4
+#include <lz4.h>
+#endif
+
+/**
+ Serializer of pop buffer geometries.
+ The arrays and primitive sets are not written element by element like the ones of osg::Geometry,
+ but as one blob each, that loads with a single copy into the resized array. The lod ranges of the primitive sets
+ are written with them, so a loaded geometry doesn't need to sort its triangles into lods again.
+ Writing with the option "lz4" compresses the blobs if the serializer is built with LZ4.
+*/
+
+namespace {
+
+const unsigned int POP_BUFFERS_VERSION = 2;
+
+/** @brief blobs keep the byte order of the machine that wrote them */
+struct ChunkHeader
+{
+    unsigned int rawSize;
+    unsigned int storedSize;
+};
+
+enum ArraySlot
+{
+    VERTEX_ARRAY = 0,
+    NORMAL_ARRAY = 1,
+    COLOR_ARRAY = 2,
+    SECONDARY_COLOR_ARRAY = 3,
+    FOG_COORD_ARRAY = 4,
+    TEXCOORD_ARRAY = 16,
+    VERTEX_ATTRIB_ARRAY = 32
+};
+
+/** @brief array types the serializer can recreate, other arrays are not written */
+osg::Array* createArray(osg::Array::Type type)
+{
+    switch (type)
+    {
+        case osg::Array::ByteArrayType: return new osg::ByteArray();
+        case osg::Array::ShortArrayType: return new osg::ShortArray();
+        case osg::Array::IntArrayType: return new osg::IntArray();
+        case osg::Array::UByteArrayType: return new osg::UByteArray();
+        case osg::Array::UShortArrayType: return new osg::UShortArray();
+        case osg::Array::UIntArrayType: return new osg::UIntArray();
+        case osg::Array::FloatArrayType: return new osg::FloatArray();
+        case osg::Array::DoubleArrayType: return new osg::DoubleArray();
+        case osg::Array::Vec2ArrayType: return new osg::Vec2Array();
+        case osg::Array::Vec3ArrayType: return new osg::Vec3Array();
+        case osg::Array::Vec4ArrayType: return new osg::Vec4Array();
+        case osg::Array::Vec2dArrayType: return new osg::Vec2dArray();
+        case osg::Array::Vec3dArrayType: return new osg::Vec3dArray();
+        case osg::Array::Vec4dArrayType: return new osg::Vec4dArray();
+        case osg::Array::Vec2sArrayType: return new osg::Vec2sArray();
+        case osg::Array::Vec3sArrayType: return new osg::Vec3sArray();
+        case osg::Array::Vec4sArrayType: return new osg::Vec4sArray();
+        case osg::Array::Vec2usArrayType: return new osg::Vec2usArray();
+        case osg::Array::Vec4ubArrayType: return new osg::Vec4ubArray();
+        default: return NULL;
+    }
+}
+
+std::string toHex(const char* data, unsigned int size)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(2 * size, '0');
+    for (unsigned int i = 0; i < size; ++i)
+    {
+        unsigned char byte = data[i];
+        hex[2 * i] = digits[byte >> 4];
+        hex[2 * i + 1] = digits[byte & 15];
+    }
+    return hex;
+}
+
+bool fromHex(const std::string& hex, char* data, unsigned int size)
+{
+    if (hex.size() != 2 * size) { return false; }
+
+    for (unsigned int i = 0; i < size; ++i)
+    {
+        int byte = 0;
+        for (int j = 0; j < 2; ++j)
+        {
+            char c = hex[2 * i + j];
+            int digit = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+            if (digit < 0) { return false; }
+            byte = 16 * byte + digit;
+        }
+        data[i] = char(byte);
+    }
+    return true;
+}
+
+void writeChunk(osgDB::OutputStream& os, const void* data, unsigned int size, bool compress)
+{
+    const char* stored = static_cast<const char*>(data);
+    ChunkHeader header = { size, size };
+
+#ifdef OSGPOP_USE_LZ4
+    // keep the raw data if it doesn't get smaller
+    std::vector<char> compressed;
+    if (compress && size > 0)
+    {
+        compressed.resize(LZ4_compressBound(size));
+        int compressedSize = LZ4_compress_default(stored, &compressed.front(), size, compressed.size());
+        if (compressedSize > 0 && (unsigned int)compressedSize < size)
+        {
+            stored = &compressed.front();
+            header.storedSize = compressedSize;
+        }
+    }
+#else
+    (void)compress;
+#endif
+
+    os << header.rawSize << header.storedSize;
+    if (os.isBinary())
+    {
+        if (header.storedSize > 0) { os.writeCharArray(stored, header.storedSize); }
+    }
+    else
+    {
+        os.writeWrappedString(toHex(stored, header.storedSize));
+        os << std::endl;
+    }
+}
+
+ChunkHeader readChunkHeader(osgDB::InputStream& is)
+{
+    ChunkHeader header;
+    is >> header.rawSize >> header.storedSize;
+    return header;
+}
+
+/** @brief reads the chunk into data, which has to hold header.rawSize bytes */
+bool readChunk(osgDB::InputStream& is, const ChunkHeader& header, void* data)
+{
+    // uncompressed binary chunks are copied straight into the array
+    std::vector<char> stored;
+    char* target = static_cast<char*>(data);
+    if (header.storedSize != header.rawSize)
+    {
+        stored.resize(header.storedSize);
+        target = stored.empty() ? NULL : &stored.front();
+    }
+
+    if (is.isBinary())
+    {
+        if (header.storedSize > 0) { is.readCharArray(target, header.storedSize); }
+    }
+    else
+    {
+        std::string hex;
+        is.readWrappedString(hex);
+        if (!fromHex(hex, target, header.storedSize)) { return false; }
+    }
+
+    if (header.storedSize == header.rawSize) { return true; }
+
+#ifdef OSGPOP_USE_LZ4
+    return LZ4_decompress_safe(target, static_cast<char*>(data), header.storedSize, header.rawSize) == (int)header.rawSize;
+#else
+    OSG_WARN << "LevelOfDetailGeometry serializer: skipping LZ4 compressed chunk, the serializer was built without LZ4" << std::endl;
+    return false;
+#endif
+}
+
+/** @brief reads a chunk the caller doesn't need, e.g. of an unknown array type */
+void skipChunk(osgDB::InputStream& is, const ChunkHeader& header)
+{
+    std::vector<char> data(header.rawSize);
+    readChunk(is, header, data.empty() ? NULL : &data.front());
+}
+
+void writeGLintVector(osgDB::OutputStream& os, const std::vector<GLint>& values)
+{
+    os << (unsigned int)values.size();
+    for (auto value: values) { os << value; }
+    os << std::endl;
+}
+
+std::vector<GLint> readGLintVector(osgDB::InputStream& is)
+{
+    unsigned int size = 0;
+    is >> size;
+    std::vector<GLint> values(size);
+    for (unsigned int i = 0; i < size; ++i) { is >> values[i]; }
+    return values;
+}
+
+void collectArrays(const osg::LevelOfDetailGeometry& geometry, std::vector<std::pair<unsigned int, const osg::Array*> >& arrays)
+{
+    arrays.push_back(std::make_pair((unsigned int)VERTEX_ARRAY, geometry.getVertexArray()));
+    arrays.push_back(std::make_pair((unsigned int)NORMAL_ARRAY, geometry.getNormalArray()));
+    arrays.push_back(std::make_pair((unsigned int)COLOR_ARRAY, geometry.getColorArray()));
+    arrays.push_back(std::make_pair((unsigned int)SECONDARY_COLOR_ARRAY, geometry.getSecondaryColorArray()));
+    arrays.push_back(std::make_pair((unsigned int)FOG_COORD_ARRAY, geometry.getFogCoordArray()));
+    for (unsigned int i = 0; i < geometry.getNumTexCoordArrays(); ++i)
+    {
+        arrays.push_back(std::make_pair(TEXCOORD_ARRAY + i, geometry.getTexCoordArray(i)));
+    }
+    for (unsigned int i = 0; i < geometry.getNumVertexAttribArrays(); ++i)
+    {
+        arrays.push_back(std::make_pair(VERTEX_ATTRIB_ARRAY + i, geometry.getVertexAttribArray(i)));
+    }
+
+    // drop missing arrays and the ones that can't be read again
+    std::vector<std::pair<unsigned int, const osg::Array*> > writable;
+    for (auto& array: arrays)
+    {
+        if (!array.second) { continue; }
+
+        osg::ref_ptr<osg::Array> prototype = createArray(array.second->getType());
+        if (prototype) { writable.push_back(array); }
+        else { OSG_WARN << "LevelOfDetailGeometry serializer: can't write array of type " << array.second->getType() << std::endl; }
+    }
+    arrays.swap(writable);
+}
+
+void setArray(osg::LevelOfDetailGeometry& geometry, unsigned int slot, osg::Array* array)
+{
+    if (slot == VERTEX_ARRAY) { geometry.setVertexArray(array); }
+    else if (slot == NORMAL_ARRAY) { geometry.setNormalArray(array); }
+    else if (slot == COLOR_ARRAY) { geometry.setColorArray(array); }
+    else if (slot == SECONDARY_COLOR_ARRAY) { geometry.setSecondaryColorArray(array); }
+    else if (slot == FOG_COORD_ARRAY) { geometry.setFogCoordArray(array); }
+    else if (slot >= VERTEX_ATTRIB_ARRAY) { geometry.setVertexAttribArray(slot - VERTEX_ATTRIB_ARRAY, array); }
+    else if (slot >= TEXCOORD_ARRAY) { geometry.setTexCoordArray(slot - TEXCOORD_ARRAY, array); }
+}
+
+osg::DrawElements* createDrawElements(osg::PrimitiveSet::Type type, GLenum mode, bool lod)
+{
+    switch (type)
+    {
+        case osg::PrimitiveSet::DrawElementsUBytePrimitiveType:
+            return lod ? (osg::DrawElements*)new osg::LevelOfDetailDrawElementsUByte(mode) : new osg::DrawElementsUByte(mode);
+        case osg::PrimitiveSet::DrawElementsUShortPrimitiveType:
+            return lod ? (osg::DrawElements*)new osg::LevelOfDetailDrawElementsUShort(mode) : new osg::DrawElementsUShort(mode);
+        case osg::PrimitiveSet::DrawElementsUIntPrimitiveType:
+            return lod ? (osg::DrawElements*)new osg::LevelOfDetailDrawElementsUInt(mode) : new osg::DrawElementsUInt(mode);
+        default:
+            return NULL;
+    }
+}
+
+}
+
+static bool checkPopBuffers(const osg::LevelOfDetailGeometry&)
+{
+    return true;
+}
+
+static bool writePopBuffers(osgDB::OutputStream& os, const osg::LevelOfDetailGeometry& geometry)
+{
+    const osgDB::Options* options = os.getOptions();
+    bool compress = options && options->getOptionString().find("lz4") != std::string::npos;
+
+    os << POP_BUFFERS_VERSION << os.BEGIN_BRACKET << std::endl;
+
+    os << geometry.getMinBounds() << geometry.getMaxBounds() << std::endl;
+    os << geometry.getNumberOfProtectedVertices() << geometry.getCompressedAttributes() << std::endl;
+    os << geometry.getCompressionOrigin() << geometry.getCompressionStep()
+       << geometry.getCompressionOffset(0) << geometry.getCompressionOffset(1) << geometry.getCompressionOffset(2) << std::endl;
+
+    const std::vector<float>& lodErrors = geometry.getLodErrors();
+    os << (unsigned int)lodErrors.size();
+    for (auto error: lodErrors) { os << error; }
+    os << std::endl;
+
+    std::vector<std::pair<unsigned int, const osg::Array*> > arrays;
+    collectArrays(geometry, arrays);
+    os << (unsigned int)arrays.size() << std::endl;
+    for (auto& slotAndArray: arrays)
+    {
+        const osg::Array* array = slotAndArray.second;
+        os << slotAndArray.first << (int)array->getType() << (int)array->getBinding() << array->getNormalize()
+           << array->getNumElements() << std::endl;
+        writeChunk(os, array->getDataPointer(), array->getTotalDataSize(), compress);
+    }
+
+    // only indexed primitives, the converter doesn't create others
+    std::vector<const osg::DrawElements*> primitiveSets;
+    for (unsigned int i = 0; i < geometry.getNumPrimitiveSets(); ++i)
+    {
+        const osg::DrawElements* drawElements = geometry.getPrimitiveSet(i)->getDrawElements();
+        if (drawElements) { primitiveSets.push_back(drawElements); }
+        else { OSG_WARN << "LevelOfDetailGeometry serializer: can't write primitive set " << i << ", it isn't indexed" << std::endl; }
+    }
+
+    os << (unsigned int)primitiveSets.size() << std::endl;
+    for (auto drawElements: primitiveSets)
+    {
+        const osg::LevelOfDetailDrawElements* lodDrawElements = dynamic_cast<const osg::LevelOfDetailDrawElements*>(drawElements);
+        os << (int)drawElements->getType() << (unsigned int)drawElements->getMode() << (lodDrawElements != NULL) << std::endl;
+        writeGLintVector(os, lodDrawElements ? lodDrawElements->getLodRanges() : std::vector<GLint>());
+        writeGLintVector(os, lodDrawElements ? lodDrawElements->getVertexRanges() : std::vector<GLint>());
+
+        os << drawElements->getNumIndices() << std::endl;
+        writeChunk(os, drawElements->getDataPointer(), drawElements->getTotalDataSize(), compress);
+    }
+
+    os << os.END_BRACKET << std::endl;
+
+    return true;
+}
+
+static bool readPopBuffers(osgDB::InputStream& is, osg::LevelOfDetailGeometry& geometry)
+{
+    unsigned int version = 0;
+    is >> version >> is.BEGIN_BRACKET;
+    if (version != POP_BUFFERS_VERSION)
+    {
+        OSG_WARN << "LevelOfDetailGeometry serializer: unknown version " << version << std::endl;
+        return false;
+    }
+
+    // the state set was read by the drawable serializer and replaced the one with the lod uniforms of the constructor
+    geometry.reconnectUniforms();
+
+    osg::Vec3 min, max;
+    int numProtectedVertices = 0;
+    int compressedAttributes = 0;
+    is >> min >> max >> numProtectedVertices >> compressedAttributes;
+    geometry.setMinBounds(min);
+    geometry.setMaxBounds(max);
+    geometry.setNumberOfProtectedVertices(numProtectedVertices);
+    geometry.setCompressedAttributes(compressedAttributes);
+
+    osg::Vec3 compressionOrigin, compressionStep;
+    int compressionOffset[3] = { 0, 0, 0 };
+    is >> compressionOrigin >> compressionStep >> compressionOffset[0] >> compressionOffset[1] >> compressionOffset[2];
+    geometry.setCompressionGrid(compressionOrigin, compressionStep, compressionOffset);
+
+    unsigned int numLodErrors = 0;
+    is >> numLodErrors;
+    std::vector<float> lodErrors(numLodErrors);
+    for (unsigned int i = 0; i < numLodErrors; ++i) { is >> lodErrors[i]; }
+    geometry.setLodErrors(lodErrors);
+
+    unsigned int numArrays = 0;
+    is >> numArrays;
+    for (unsigned int i = 0; i < numArrays; ++i)
+    {
+        unsigned int slot = 0, numElements = 0;
+        int type = 0, binding = 0;
+        bool normalize = false;
+        is >> slot >> type >> binding >> normalize >> numElements;
+
+        ChunkHeader header = readChunkHeader(is);
+        osg::ref_ptr<osg::Array> array = createArray((osg::Array::Type)type);
+        if (array) { array->resizeArray(numElements); }
+        if (!array || array->getTotalDataSize() != header.rawSize)
+        {
+            OSG_WARN << "LevelOfDetailGeometry serializer: skipping array " << slot << " of type " << type << std::endl;
+            skipChunk(is, header);
+            continue;
+        }
+
+        if (!readChunk(is, header, const_cast<GLvoid*>(array->getDataPointer()))) { return false; }
+
+        array->setBinding((osg::Array::Binding)binding);
+        array->setNormalize(normalize);
+        setArray(geometry, slot, array);
+    }
+
+    unsigned int numPrimitiveSets = 0;
+    is >> numPrimitiveSets;
+    for (unsigned int i = 0; i < numPrimitiveSets; ++i)
+    {
+        int type = 0;
+        unsigned int mode = 0, numIndices = 0;
+        bool lod = false;
+        is >> type >> mode >> lod;
+        std::vector<GLint> lodRanges = readGLintVector(is);
+        std::vector<GLint> vertexRanges = readGLintVector(is);
+        is >> numIndices;
+
+        ChunkHeader header = readChunkHeader(is);
+        osg::ref_ptr<osg::DrawElements> drawElements = createDrawElements((osg::PrimitiveSet::Type)type, mode, lod);
+        if (drawElements) { drawElements->resizeElements(numIndices); }
+        if (!drawElements || drawElements->getTotalDataSize() != header.rawSize)
+        {
+            OSG_WARN << "LevelOfDetailGeometry serializer: skipping primitive set " << i << " of type " << type << std::endl;
+            skipChunk(is, header);
+            continue;
+        }
+
+        if (!readChunk(is, header, const_cast<GLvoid*>(drawElements->getDataPointer()))) { return false; }
+
+        osg::LevelOfDetailDrawElements* lodDrawElements = dynamic_cast<osg::LevelOfDetailDrawElements*>(drawElements.get());
+        if (lodDrawElements && lodRanges.size() == 32)
+        {
+            lodDrawElements->setLodRanges(lodRanges);
+            lodDrawElements->setVertexRanges(vertexRanges);
+            lodDrawElements->setLod(31);
+        }
+        geometry.addPrimitiveSet(drawElements);
+    }
+
+    is >> is.END_BRACKET;
+
+    return true;
+}
+
+REGISTER_OBJECT_WRAPPER( LevelOfDetailGeometry,
+                         new osg::LevelOfDetailGeometry,
+                         osg::LevelOfDetailGeometry,
+                         "osg::Object osg::Drawable osg::LevelOfDetailGeometry" )
+{
+    // the arrays and primitive sets are part of the pop buffers, so the serializers of osg::Geometry are left out
+    ADD_USER_SERIALIZER( PopBuffers );
+    ADD_FLOAT_SERIALIZER( MaxViewSpaceError, 1.0f );
+    ADD_FLOAT_SERIALIZER( LodHysteresis, 0.25f );
+    ADD_BOOL_SERIALIZER( Geomorphing, false );
+}
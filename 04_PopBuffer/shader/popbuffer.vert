@@ -28,16 +28,16 @@ void main()
 	gl_Position = gl_ModelViewProjectionMatrix * vertex;
 	//gl_Position = vec4(gl_MultiTexCoord0.st * 2.0 - 1.0, -1.0, 1.0);
 	
-	normal = normalize(gl_NormalMatrix * gl_Normal);
+	normal = normalize(gl_NormalMatrix * decodeNormal());
 
-	vec3 eye = normalize(-(gl_ModelViewMatrix * gl_Vertex).xyz);
+	vec3 eye = normalize(-(gl_ModelViewMatrix * vertex).xyz);
 	viewSpace_lightDir[0] = normalize(gl_NormalMatrix * lightDirection[0].xyz);
 	viewSpace_lightDir[1] = normalize(gl_NormalMatrix * lightDirection[1].xyz);
 	viewSpace_lightDir[2] = normalize(gl_NormalMatrix * lightDirection[2].xyz);
 	halfVector[0] = normalize(viewSpace_lightDir[0] + eye);
 	halfVector[1] = normalize(viewSpace_lightDir[1] + eye);
 	halfVector[2] = normalize(viewSpace_lightDir[2] + eye);
-	texCoord = gl_MultiTexCoord0.st;
+	texCoord = decodeTexCoord();
 
 	if (visualizeLod)
 	{
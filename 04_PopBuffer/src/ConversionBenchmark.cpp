@@ -0,0 +1,349 @@
+#include "ConversionBenchmark.h"
+#include "ConvertToLevelOfDetailGeometryVisitor.h"
+#include "HalfEdge.h"
+#include "VertexCacheOptimizer.h"
+
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+
+#include <osg/Geode>
+#include <osg/Timer>
+#include <osg/TriangleIndexFunctor>
+#include <osgDB/Registry>
+#include <osgDB/ReaderWriter>
+#include <osgDB/ObjectWrapper>
+
+namespace osgExample {
+
+namespace {
+
+/**
+ @brief finds the lod of each triangle by testing the quantization levels one after another
+*/
+struct ReferenceLodTriangleCollector
+{
+    osg::ref_ptr<osg::Vec3Array>                        _vertexArray;
+    std::vector<osg::ref_ptr<osg::DrawElementsUInt> >*  _lodDrawElements;
+    osg::Vec3 _min;
+    osg::Vec3 _max;
+    unsigned int _numProtectedVertices;
+
+    ReferenceLodTriangleCollector()
+        : _vertexArray(NULL)
+        , _lodDrawElements(NULL)
+        , _numProtectedVertices(0)
+    {
+    }
+
+    void operator()(unsigned int pos1, unsigned int pos2, unsigned int pos3)
+    {
+        // skip collapsed triangles
+        if (_vertexArray->at(pos1) == _vertexArray->at(pos2)  ||
+            _vertexArray->at(pos1) == _vertexArray->at(pos3)  ||
+            _vertexArray->at(pos2) == _vertexArray->at(pos3))
+        {
+            return;
+        }
+
+        for (int k = 1; k <= 32; ++k)
+        {
+            osg::Vec3 vertices[3] = { _vertexArray->at(pos1),
+                                      _vertexArray->at(pos2),
+                                      _vertexArray->at(pos3) };
+
+            osgUtil::Vec3ui qVertices[3] = { osgUtil::quantize(k, _min, _max, vertices[0]),
+                                             osgUtil::quantize(k, _min, _max, vertices[1]),
+                                             osgUtil::quantize(k, _min, _max, vertices[2]) };
+
+            osg::Vec3 newVertices[3] = { (pos1 < _numProtectedVertices) ? vertices[0] : osgUtil::dequantize<osg::Vec3>(k, _min, _max, qVertices[0]),
+                                         (pos2 < _numProtectedVertices) ? vertices[1] : osgUtil::dequantize<osg::Vec3>(k, _min, _max, qVertices[1]),
+                                         (pos3 < _numProtectedVertices) ? vertices[2] : osgUtil::dequantize<osg::Vec3>(k, _min, _max, qVertices[2]) };
+
+            if ((newVertices[0] != newVertices[1] &&
+                 newVertices[0] != newVertices[2] &&
+                 newVertices[1] != newVertices[2]) ||
+                k == 32)
+            {
+                (*_lodDrawElements)[k-1]->push_back(pos1);
+                (*_lodDrawElements)[k-1]->push_back(pos2);
+                (*_lodDrawElements)[k-1]->push_back(pos3);
+
+                break;
+            }
+        }
+    }
+};
+
+class CollectGeometriesVisitor : public osg::NodeVisitor
+{
+public:
+    CollectGeometriesVisitor()
+        : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN)
+    {
+    }
+
+    virtual void apply(osg::Geode& geode)
+    {
+        for (unsigned int i = 0; i < geode.getNumDrawables(); ++i)
+        {
+            osg::ref_ptr<osg::Geometry> geometry = dynamic_cast<osg::Geometry*>(geode.getDrawable(i));
+            if (geometry && dynamic_cast<osg::Vec3Array*>(geometry->getVertexArray())) { m_geometries.push_back(geometry); }
+        }
+    }
+
+    std::vector<osg::ref_ptr<osg::Geometry> > m_geometries;
+};
+
+/**
+ @brief number of vertex cache misses of all triangles of a geometry, drawn with its finest lod
+*/
+float countCacheMisses(osg::ref_ptr<osg::Geometry> geometry, unsigned int* numTriangles)
+{
+    std::vector<unsigned int> indices;
+    for (unsigned int i = 0; i < geometry->getNumPrimitiveSets(); ++i)
+    {
+        const osg::DrawElements* drawElements = geometry->getPrimitiveSet(i)->getDrawElements();
+        if (!drawElements) { continue; }
+
+        for (unsigned int j = 0; j < drawElements->getNumIndices(); ++j) { indices.push_back(drawElements->getElement(j)); }
+    }
+
+    *numTriangles += indices.size() / 3;
+    return indices.empty() ? 0.0f : osgUtil::computeAcmr(&indices.front(), indices.size()) * (indices.size() / 3);
+}
+
+}
+
+osg::ref_ptr<osg::Geometry> ConversionBenchmark::createGrid(unsigned int numTriangles)
+{
+    // a grid with n x n quads has 2 * n * n triangles
+    unsigned int n = std::max(1u, (unsigned int)std::ceil(std::sqrt(numTriangles / 2.0)));
+
+    osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array();
+    osg::ref_ptr<osg::Vec3Array> normals = new osg::Vec3Array();
+    vertices->reserve((n + 1) * (n + 1));
+    normals->reserve((n + 1) * (n + 1));
+    for (unsigned int y = 0; y <= n; ++y)
+    {
+        for (unsigned int x = 0; x <= n; ++x)
+        {
+            // displace the grid, so that the quantization produces all kinds of lods
+            float u = float(x) / n;
+            float v = float(y) / n;
+            vertices->push_back(osg::Vec3(u, v, 0.05f * std::sin(u * 20.0f) * std::cos(v * 20.0f)));
+            normals->push_back(osg::Vec3(0.0f, 0.0f, 1.0f));
+        }
+    }
+
+    osg::ref_ptr<osg::DrawElementsUInt> triangles = new osg::DrawElementsUInt(GL_TRIANGLES);
+    triangles->reserve(6 * n * n);
+    for (unsigned int y = 0; y < n; ++y)
+    {
+        for (unsigned int x = 0; x < n; ++x)
+        {
+            unsigned int i = y * (n + 1) + x;
+            triangles->push_back(i);
+            triangles->push_back(i + 1);
+            triangles->push_back(i + n + 1);
+            triangles->push_back(i + n + 1);
+            triangles->push_back(i + 1);
+            triangles->push_back(i + n + 2);
+        }
+    }
+
+    osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry();
+    geometry->setVertexArray(vertices);
+    geometry->setNormalArray(normals);
+    geometry->setNormalBinding(osg::Geometry::BIND_PER_VERTEX);
+    geometry->addPrimitiveSet(triangles);
+
+    return geometry;
+}
+
+bool ConversionBenchmark::verifyLodLevels(osg::ref_ptr<osg::Geometry> geometry, unsigned int numProtectedVertices)
+{
+    osg::BoundingBox bounds = geometry->getBound();
+    osg::Vec3 min = bounds._min;
+    osg::Vec3 max = bounds._max;
+    for (int i = 0; i < 3; ++i)
+    {
+        if (!(max[i] > min[i])) { max[i] = min[i] + 1.0f; }
+    }
+
+    std::vector<osg::ref_ptr<osg::DrawElementsUInt> > lodDrawElements;
+    std::vector<osg::ref_ptr<osg::DrawElementsUInt> > referenceLodDrawElements;
+    for (size_t j = 0; j < 32; ++j)
+    {
+        lodDrawElements.push_back(new osg::DrawElementsUInt(GL_TRIANGLES));
+        referenceLodDrawElements.push_back(new osg::DrawElementsUInt(GL_TRIANGLES));
+    }
+
+    osg::TriangleIndexFunctor<osgUtil::LodTriangleCollector<osg::Vec3Array, osg::Vec3> > triangleCollector;
+    triangleCollector._vertexArray = dynamic_cast<osg::Vec3Array*>(geometry->getVertexArray());
+    triangleCollector._lodDrawElements = &lodDrawElements;
+    triangleCollector._numProtectedVertices = numProtectedVertices;
+    triangleCollector.setBounds(min, max);
+
+    osg::TriangleIndexFunctor<ReferenceLodTriangleCollector> referenceCollector;
+    referenceCollector._vertexArray = triangleCollector._vertexArray;
+    referenceCollector._lodDrawElements = &referenceLodDrawElements;
+    referenceCollector._numProtectedVertices = numProtectedVertices;
+    referenceCollector._min = min;
+    referenceCollector._max = max;
+
+    for (unsigned int i = 0; i < geometry->getNumPrimitiveSets(); ++i)
+    {
+        geometry->getPrimitiveSet(i)->accept(triangleCollector);
+        triangleCollector.flush();
+        geometry->getPrimitiveSet(i)->accept(referenceCollector);
+    }
+
+    for (size_t j = 0; j < 32; ++j)
+    {
+        if (lodDrawElements[j]->asVector() != referenceLodDrawElements[j]->asVector()) { return false; }
+    }
+
+    return true;
+}
+
+bool ConversionBenchmark::verifyLodLevels(osg::ref_ptr<osg::Node> model)
+{
+    CollectGeometriesVisitor visitor;
+    model->accept(visitor);
+
+    bool valid = true;
+    for (auto geometry: visitor.m_geometries)
+    {
+        // test the unconverted geometry and the converted one, which has protected vertices
+        valid = valid && verifyLodLevels(geometry, 0);
+
+        osg::ref_ptr<osg::LevelOfDetailGeometry> lodGeometry = osgUtil::ConvertToLevelOfDetailGeometryVisitor().convert(geometry);
+        if (lodGeometry && dynamic_cast<osg::Vec3Array*>(lodGeometry->getVertexArray()))
+        {
+            valid = valid && verifyLodLevels(lodGeometry.get(), lodGeometry->getNumberOfProtectedVertices());
+        }
+    }
+
+    m_out << "Verified lods of " << visitor.m_geometries.size() << " geometries: " << (valid ? "identical" : "MISMATCH") << std::endl;
+
+    return valid;
+}
+
+void ConversionBenchmark::compareCacheMissRatios(osg::ref_ptr<osg::Node> model)
+{
+    CollectGeometriesVisitor visitor;
+    model->accept(visitor);
+
+    // weight the ratio of every geometry by its triangles
+    float misses[2] = { 0.0f, 0.0f };
+    unsigned int numTriangles[2] = { 0, 0 };
+    for (auto geometry: visitor.m_geometries)
+    {
+        for (int optimize = 0; optimize < 2; ++optimize)
+        {
+            osgUtil::ConvertToLevelOfDetailGeometryVisitor lodVisitor;
+            lodVisitor.setOptimizeVertexCache(optimize != 0);
+            osg::ref_ptr<osg::LevelOfDetailGeometry> lodGeometry = lodVisitor.convert(geometry);
+            if (lodGeometry) { misses[optimize] += countCacheMisses(lodGeometry.get(), &numTriangles[optimize]); }
+        }
+    }
+
+    m_out << "ACMR of " << numTriangles[1] << " triangles: "
+          << (numTriangles[0] ? misses[0] / numTriangles[0] : 0.0f) << " unoptimized, "
+          << (numTriangles[1] ? misses[1] / numTriangles[1] : 0.0f) << " optimized" << std::endl;
+}
+
+void ConversionBenchmark::compareLoadTimes(osg::ref_ptr<osg::Node> model)
+{
+    osgDB::ReaderWriter* readerWriter = osgDB::Registry::instance()->getReaderWriterForExtension("osgb");
+    if (!readerWriter || !osgDB::Registry::instance()->getObjectWrapperManager()->findWrapper("osg::LevelOfDetailGeometry"))
+    {
+        m_out << "Load times: the osgb plugin or the pop buffer serializer is missing" << std::endl;
+        return;
+    }
+
+    CollectGeometriesVisitor visitor;
+    model->accept(visitor);
+
+    osg::ref_ptr<osg::Geode> popGeode = new osg::Geode();
+    osg::ref_ptr<osg::Geode> geometryGeode = new osg::Geode();
+    for (auto geometry: visitor.m_geometries)
+    {
+        osg::ref_ptr<osg::LevelOfDetailGeometry> lodGeometry = osgUtil::ConvertToLevelOfDetailGeometryVisitor().convert(geometry);
+        if (!lodGeometry) { continue; }
+
+        popGeode->addDrawable(lodGeometry);
+        geometryGeode->addDrawable(new osg::Geometry(*lodGeometry));
+    }
+
+    struct Format
+    {
+        const char* name;
+        osg::Geode* geode;
+        const char* options;
+    };
+    const Format formats[] = { { "pop buffers", popGeode.get(), "" },
+                               { "pop buffers lz4", popGeode.get(), "lz4" },
+                               { "geometries", geometryGeode.get(), "" } };
+
+    m_out << "format\tsize [bytes]\tload [ms]" << std::endl;
+    for (auto& format: formats)
+    {
+        osg::ref_ptr<osgDB::Options> options = new osgDB::Options(format.options);
+        std::stringstream file;
+        if (!readerWriter->writeNode(*format.geode, file, options.get()).success()) { continue; }
+        std::string data = file.str();
+
+        // the fastest of a few reads, the first one also pays for loading the wrappers
+        const int numReads = 5;
+        double milliseconds = 0.0;
+        for (int i = 0; i < numReads; ++i)
+        {
+            std::istringstream in(data);
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            osg::ref_ptr<osg::Node> node = readerWriter->readNode(in, options.get()).getNode();
+            double readMilliseconds = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+            if (!node) { break; }
+
+            milliseconds = (i == 0) ? readMilliseconds : std::min(milliseconds, readMilliseconds);
+        }
+
+        m_out << format.name << "\t" << data.size() << "\t" << milliseconds << std::endl;
+    }
+}
+
+bool ConversionBenchmark::run(const std::vector<unsigned int>& triangleCounts)
+{
+    bool valid = true;
+    m_out << "triangles\tvertices\tconversion [ms]\ttriangles/s" << std::endl;
+
+    for (auto numTriangles: triangleCounts)
+    {
+        osg::ref_ptr<osg::Geode> geode = new osg::Geode();
+        osg::ref_ptr<osg::Geometry> geometry = createGrid(numTriangles);
+        geode->addDrawable(geometry);
+
+        // the reference lod search is slow, only verify the smaller grids
+        if (numTriangles <= 1000000)
+        {
+            valid = verifyLodLevels(geode.get()) && valid;
+            compareCacheMissRatios(geode.get());
+        }
+
+        unsigned int numVertices = geometry->getVertexArray()->getNumElements();
+        unsigned int numGridTriangles = geometry->getPrimitiveSet(0)->getNumIndices() / 3;
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        osgUtil::ConvertToLevelOfDetailGeometryVisitor lodVisitor;
+        geode->accept(lodVisitor);
+        double milliseconds = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+
+        m_out << numGridTriangles << "\t" << numVertices << "\t" << milliseconds << "\t"
+              << numGridTriangles / (milliseconds / 1000.0) << std::endl;
+    }
+
+    return valid;
+}
+
+}
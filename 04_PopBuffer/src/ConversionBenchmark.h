@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include <ostream>
+
+#include <osg/ref_ptr>
+#include <osg/Node>
+#include <osg/Geometry>
+
+namespace osgExample {
+
+/**
+ @brief Measures how long the pop buffer conversion takes for synthetic meshes of growing size.
+*/
+class ConversionBenchmark {
+public:
+    ConversionBenchmark(std::ostream& out)
+        : m_out(out)
+    {
+    }
+
+    /**
+     @brief converts one grid per triangle count and prints the timings
+     @return true if the lods of all verified grids match
+    */
+    bool run(const std::vector<unsigned int>& triangleCounts);
+
+    /**
+     @brief checks that the batched lod search sorts every triangle of the model into the same lod
+     as testing each quantization level one after another
+     @return true if all lods match
+    */
+    bool verifyLodLevels(osg::ref_ptr<osg::Node> model);
+
+    /**
+     @brief converts the model with and without the vertex cache optimization and prints the average cache miss ratio
+     (ACMR) of the finest lod of both
+    */
+    void compareCacheMissRatios(osg::ref_ptr<osg::Node> model);
+
+    /**
+     @brief converts the model and prints how long reading it back from an in memory .osgb takes with the pop buffer serializer,
+     with and without LZ4, and as plain geometries, whose arrays are read element by element and lose their lod ranges
+    */
+    void compareLoadTimes(osg::ref_ptr<osg::Node> model);
+
+    /**
+     @brief creates an indexed, slightly displaced grid with at least numTriangles triangles
+    */
+    static osg::ref_ptr<osg::Geometry> createGrid(unsigned int numTriangles);
+private:
+    bool verifyLodLevels(osg::ref_ptr<osg::Geometry> geometry, unsigned int numProtectedVertices);
+
+    std::ostream& m_out;
+};
+
+}
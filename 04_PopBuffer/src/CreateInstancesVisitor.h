@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <osg/NodeVisitor>
+#include <osg/Geode>
+#include "InstancedLevelOfDetailGeometry.h"
+
+namespace osgExample
+{
+
+/**
+ @brief Replaces every pop buffer geometry with an instanced one, that draws it on a square grid of instances
+*/
+class CreateInstances : public osg::NodeVisitor
+{
+public:
+	CreateInstances(unsigned int numInstances)
+		: osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN)
+		, _numInstances(numInstances)
+	{
+	}
+
+	virtual void apply(osg::Geode& geode)
+	{
+		for (unsigned int i = 0; i < geode.getNumDrawables(); ++i)
+		{
+			osg::ref_ptr<osg::LevelOfDetailGeometry> lodGeometry = dynamic_cast<osg::LevelOfDetailGeometry*>(geode.getDrawable(i));
+
+			if (lodGeometry && !dynamic_cast<osg::InstancedLevelOfDetailGeometry*>(lodGeometry.get()))
+			{
+				osg::ref_ptr<osg::InstancedLevelOfDetailGeometry> instancedGeometry = new osg::InstancedLevelOfDetailGeometry(*lodGeometry);
+				instancedGeometry->setInstanceMatrices(createMatrices(lodGeometry->getBound()));
+				geode.setDrawable(i, instancedGeometry);
+			}
+		}
+	}
+protected:
+	std::vector<osg::Matrixf> createMatrices(const osg::BoundingBox& bounds) const
+	{
+		// place the instances on the xy plane with some space between them and vary their orientation
+		unsigned int gridSize = static_cast<unsigned int>(ceil(sqrt(double(_numInstances))));
+		float spacing = 2.5f * bounds.radius();
+
+		std::vector<osg::Matrixf> matrices;
+		for (unsigned int i = 0; i < _numInstances; ++i)
+		{
+			osg::Vec3 position((i % gridSize) * spacing, (i / gridSize) * spacing, 0.0f);
+			matrices.push_back(osg::Matrixf::translate(-bounds.center()) *
+			                   osg::Matrixf::rotate(i * 0.7f, osg::Vec3(0.0f, 0.0f, 1.0f)) *
+			                   osg::Matrixf::translate(bounds.center() + position));
+		}
+
+		return matrices;
+	}
+
+	unsigned int _numInstances;
+};
+
+}
@@ -1,11 +1,33 @@
 #include "DemoEventHandler.h"
+#include "MeshletDrawElements.h"
 
 #include <osg/Switch>
+#include <osgViewer/View>
+#include <osgViewer/ViewerBase>
 
 namespace osgExample {
 
 bool DemoEventHandler::handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa)
 {
+	if (ea.getEventType() == osgGA::GUIEventAdapter::FRAME)
+	{
+		// the lod changes were counted by the cull traversal of the previous frame
+		unsigned int numLodTransitions = osg::LevelOfDetailGeometry::resetNumLodTransitions();
+		unsigned int numCulledTriangles = MeshletDrawElements::resetNumCulledTriangles();
+		osgViewer::View* view = dynamic_cast<osgViewer::View*>(&aa);
+		if (view && view->getFrameStamp() && view->getFrameStamp()->getFrameNumber() > 0 && view->getViewerBase()->getViewerStats())
+		{
+			view->getViewerBase()->getViewerStats()->setAttribute(view->getFrameStamp()->getFrameNumber() - 1, "Pop lod transitions", numLodTransitions);
+			view->getViewerBase()->getViewerStats()->setAttribute(view->getFrameStamp()->getFrameNumber() - 1, "Meshlet culled triangles", numCulledTriangles);
+			if (m_triangleBudget)
+			{
+				view->getViewerBase()->getViewerStats()->setAttribute(view->getFrameStamp()->getFrameNumber() - 1, "Pop budget triangles", m_triangleBudget->getNumTriangles());
+				view->getViewerBase()->getViewerStats()->setAttribute(view->getFrameStamp()->getFrameNumber() - 1, "Pop budget error", m_triangleBudget->getAchievedError());
+			}
+		}
+		return false;
+	}
+
 	if (ea.getEventType() == osgGA::GUIEventAdapter::KEYDOWN)
 	{
 		switch(ea.getKey())
@@ -28,6 +50,16 @@ bool DemoEventHandler::handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIAction
 			std::cout << "Changed maximum viewspace error to: " << m_maxViewSpaceError << std::endl;
 			return true;
 		} break;
+		case osgGA::GUIEventAdapter::KEY_Page_Up:
+		case osgGA::GUIEventAdapter::KEY_Page_Down:
+		{
+			if (!m_triangleBudget) { break; }
+
+			float factor = (ea.getKey() == osgGA::GUIEventAdapter::KEY_Page_Up) ? 1.25f : 0.8f;
+			m_triangleBudget->setMaxTriangles(std::max(1000u, (unsigned int)(m_triangleBudget->getMaxTriangles() * factor)));
+			std::cout << "Changed triangle budget to: " << m_triangleBudget->getMaxTriangles() << std::endl;
+			return true;
+		} break;
         case osgGA::GUIEventAdapter::KEY_T:
         {
             m_textured = !m_textured;
@@ -42,6 +74,13 @@ bool DemoEventHandler::handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIAction
             m_visualizeLod = !m_visualizeLod;
             m_visualizeLodUniform->set(m_visualizeLod);
             break;
+        case osgGA::GUIEventAdapter::KEY_G:
+        {
+            m_geomorphing = !m_geomorphing;
+            osgExample::SetGeomorphing visitor(m_geomorphing);
+            m_scene->accept(visitor);
+            std::cout << "Geomorphing " << (m_geomorphing ? "on" : "off") << std::endl;
+        } break;
         case osgGA::GUIEventAdapter::KEY_1:
             m_scene->setAllChildrenOff();
             m_scene->setValue(0, true);
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "UpdateViewSpaceErrorVisitor.h"
+#include "SetGeomorphingVisitor.h"
+#include "TriangleBudgetCallback.h"
 #include <iostream>
 #include <osgGA/GUIEventHandler>
 
@@ -18,17 +20,23 @@ public:
         ,   m_texturedUniform(texturedUniform)
         ,   m_visualizeLod(false)
         ,   m_textured(true)
+        ,   m_geomorphing(false)
 	{
 	}
 
+	/** @brief reports the error and triangles of the budget to the stats, page up and down change the budget */
+	inline void setTriangleBudget(osg::ref_ptr<osg::TriangleBudgetCallback> triangleBudget) { m_triangleBudget = triangleBudget; }
+
 	virtual bool handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa);
 private:
 	osg::ref_ptr<osg::Switch>   m_scene;
     osg::ref_ptr<osg::Uniform>  m_visualizeLodUniform;
     osg::ref_ptr<osg::Uniform>  m_texturedUniform;
+    osg::ref_ptr<osg::TriangleBudgetCallback> m_triangleBudget;
 	float						m_maxViewSpaceError;
     bool                        m_visualizeLod;
     bool                        m_textured;
+    bool                        m_geomorphing;
 };
 
 }
\ No newline at end of file
@@ -1,8 +1,10 @@
 #include "KdTreeVisitor.h"
+#include "ParallelFor.h"
 
 #include <algorithm>
 
 #include <osg/Geode>
+#include <osg/BoundingBox>
 #include <osg/TriangleIndexFunctor>
 
 namespace osgExample {
@@ -17,7 +19,7 @@ template<class VertexArray, class Vector> struct TriangleCollector
 		, _drawElements(NULL)
     {
 	}
-	                    
+
     void operator()(unsigned int pos1, unsigned int pos2, unsigned int pos3)
     {
 			// skip collapsed triangles
@@ -27,7 +29,7 @@ template<class VertexArray, class Vector> struct TriangleCollector
 			{
 				return;
 			}*/
-			
+
 			// add new triangle to draw primitive
             _drawElements->push_back(pos1);
             _drawElements->push_back(pos2);
@@ -35,53 +37,49 @@ template<class VertexArray, class Vector> struct TriangleCollector
     }
 };
 
-template<class Vector> struct VectorCompare
+struct CentroidCompare
 {
-    VectorCompare(KdTreeVisitor::Axis splitAxis)
-        : _splitAxis(splitAxis)
+    CentroidCompare(const std::vector<osg::Vec3>& centroids, KdTreeVisitor::Axis splitAxis)
+        : _centroids(centroids)
+        , _splitAxis(splitAxis)
     {
     }
 
-    bool operator() (const Vector& lhs, const Vector& rhs)
+    bool operator() (unsigned int lhs, unsigned int rhs) const
     {
-        switch(_splitAxis)
-        {
-        case KdTreeVisitor::X_AXIS:
-            return lhs.x() < rhs.x();
-        case KdTreeVisitor::Y_AXIS:
-            return lhs.y() < rhs.y();
-        case KdTreeVisitor::Z_AXIS:
-            return lhs.z() < rhs.z();
-        default:
-            return false;
-        }
+        return _centroids[lhs][_splitAxis] < _centroids[rhs][_splitAxis];
     }
-    
+
+    const std::vector<osg::Vec3>& _centroids;
     KdTreeVisitor::Axis _splitAxis;
 };
 
 void KdTreeVisitor::apply(osg::Geode& geode)
 {
     std::vector<osg::ref_ptr<osg::Drawable> > newDrawables;
-    
+    std::vector<osg::ref_ptr<osg::Node> > hierarchies;
+    bool outputHierarchy = m_outputHierarchy && geode.getNumParents() > 0;
+
     // convert all drawables, if necessary
     for (size_t i = 0; i < geode.getNumDrawables(); ++i)
     {
         osg::ref_ptr<osg::Geometry> geometry = dynamic_cast<osg::Geometry*>(geode.getDrawable(i));
+        std::unique_ptr<SplitNode> splitTree;
 
-        if (geometry)
+        if (geometry && geometry->getVertexArray() && geometry->getVertexArray()->getNumElements() > m_maxVertices)
         {
-            if (geometry->getVertexArray() && geometry->getVertexArray()->getNumElements() > m_maxVertices)
-            {
-                // split geometries and add them to the list of new drawables
-                std::vector<osg::ref_ptr<osg::Drawable> > temp = splitGeometry(geometry);
-                newDrawables.insert(newDrawables.end(), temp.begin(), temp.end());
-            } else {
-                // geometry has the right size simply add it
-                newDrawables.push_back(geometry);
-            }
-        } else {
+            splitTree = buildSplitTree(geometry);
+        }
+
+        if (!splitTree)
+        {
+            // geometry has the right size or can't be split, simply add it
             newDrawables.push_back(geode.getDrawable(i));
+        } else if (outputHierarchy) {
+            hierarchies.push_back(createHierarchy(*splitTree, geometry));
+        } else {
+            // add split geometries to the list of new drawables
+            collectGeometries(*splitTree, geometry, &newDrawables);
         }
     }
 
@@ -92,258 +90,162 @@ void KdTreeVisitor::apply(osg::Geode& geode)
         geode.addDrawable(drawable);
     }
 
+    if (!hierarchies.empty())
+    {
+        // replace the geode by a group with the trees of all split geometries, the remaining drawables stay in the geode
+        osg::ref_ptr<osg::Group> group = new osg::Group;
+        group->setName(geode.getName());
+        group->setNodeMask(geode.getNodeMask());
+        group->setStateSet(geode.getStateSet());
+        geode.setStateSet(NULL);
+        for (auto hierarchy: hierarchies) { group->addChild(hierarchy); }
+        if (geode.getNumDrawables() > 0) { group->addChild(&geode); }
+
+        // the parents may hold the last reference to the geode
+        osg::ref_ptr<osg::Geode> keepAlive = &geode;
+        osg::Node::ParentList parents = geode.getParents();
+        for (auto parent: parents)
+        {
+            if (parent != group) { parent->replaceChild(&geode, group); }
+        }
+        return;
+    }
+
     traverse(geode);
 }
 
-std::vector<osg::ref_ptr<osg::Drawable> > KdTreeVisitor::splitGeometry(osg::ref_ptr<osg::Geometry> geometry, Axis splitAxis)
+std::unique_ptr<KdTreeVisitor::SplitNode> KdTreeVisitor::buildSplitTree(osg::ref_ptr<osg::Geometry> geometry)
 {
-    std::vector<osg::ref_ptr<osg::Drawable> > geometries;
-
-    if (geometry->getVertexArray() && geometry->getVertexArray()->getNumElements() <= m_maxVertices)
+    // split all triangles of the geometry by their centroids
+    m_triangles = collectTriangles(geometry);
+    if (!collectCentroids(geometry->getVertexArray()))
     {
-        // geometry has the right size, stop the recursion
-        geometries.push_back(geometry);
-    } else {
-        // we need to split the geometry
-        osg::ref_ptr<osg::Array> vertexArray = geometry->getVertexArray();
-        osg::ref_ptr<osg::Array> normalArray = geometry->getNormalArray();
-        osg::ref_ptr<osg::Array> colorArray = geometry->getColorArray();
-        osg::ref_ptr<osg::Array> secondaryColorArray = geometry->getSecondaryColorArray();
-        osg::ref_ptr<osg::Array> fogCoordArray = geometry->getFogCoordArray();
-        osg::Geometry::ArrayList& texCoordArrays = geometry->getTexCoordArrayList();
-        osg::Geometry::ArrayList& vertexAttribArrays = geometry->getVertexAttribArrayList();	
-        osg::ref_ptr<osg::DrawElementsUInt> drawElements = collectTriangles(geometry);
-
-        // create two new geomtries and vertex attribute arrays
-        osg::ref_ptr<osg::Array> leftVertices = createArrayOfType(vertexArray);
-	    osg::ref_ptr<osg::Array> rightVertices = createArrayOfType(vertexArray);
-	    osg::ref_ptr<osg::Array> leftNormals = createArrayOfType(normalArray);
-	    osg::ref_ptr<osg::Array> rightNormals = createArrayOfType(normalArray);
-	    osg::ref_ptr<osg::Array> leftColors = createArrayOfType(colorArray);
-	    osg::ref_ptr<osg::Array> rightColors = createArrayOfType(colorArray);
-	    osg::ref_ptr<osg::Array> leftSecondaryColors = createArrayOfType(secondaryColorArray);
-	    osg::ref_ptr<osg::Array> rightSecondaryColors = createArrayOfType(secondaryColorArray);
-	    osg::ref_ptr<osg::Array> leftFogCoords = createArrayOfType(fogCoordArray);
-	    osg::ref_ptr<osg::Array> rightFogCoords = createArrayOfType(fogCoordArray);
-	    std::vector<osg::ref_ptr<osg::Array> > leftTexCoords;
-	    std::vector<osg::ref_ptr<osg::Array> > rightTexCoords;
-	    for (auto texCoordArray: texCoordArrays)
-	    {
-		    leftTexCoords.push_back(createArrayOfType(texCoordArray));
-		    rightTexCoords.push_back(createArrayOfType(texCoordArray));
-	    }
-	    std::vector<osg::ref_ptr<osg::Array> > leftVertexAttribs;
-	    std::vector<osg::ref_ptr<osg::Array> > rightVertexAttribs;
-	    for (auto vertexAttribArray: vertexAttribArrays)
-	    {
-		    leftVertexAttribs.push_back(createArrayOfType(vertexAttribArray));
-		    rightVertexAttribs.push_back(createArrayOfType(vertexAttribArray));
-	    }
-
-        osg::ref_ptr<osg::Geometry> left = new osg::Geometry;
-        left->setStateSet(geometry->getStateSet());
-        osg::ref_ptr<osg::DrawElementsUInt> leftDrawElements = new osg::DrawElementsUInt(GL_TRIANGLES);
-        leftDrawElements->reserve(drawElements->size() / 2);
-        left->addPrimitiveSet(leftDrawElements);
-        std::map<unsigned int, unsigned int> leftIndicesMapping;
-        left->setVertexArray(leftVertices);
-        left->setNormalArray(leftNormals);
-        left->setNormalBinding(geometry->getNormalBinding());
-        left->setColorArray(leftColors);
-        left->setColorBinding(geometry->getColorBinding());
-        left->setSecondaryColorArray(leftSecondaryColors);
-        left->setSecondaryColorBinding(geometry->getSecondaryColorBinding());
-        left->setFogCoordArray(leftFogCoords);
-	    left->setFogCoordBinding(geometry->getFogCoordBinding());
-        for (size_t j = 0; j < leftTexCoords.size(); ++j)
-	    {
-		    left->setTexCoordArray(j, leftTexCoords[j]);
-	    }
-        for (size_t j = 0; j < leftVertexAttribs.size(); ++j)
-	    {
-		    left->setVertexAttribArray(j, leftVertexAttribs[j]);
-		    left->setVertexAttribBinding(j, geometry->getVertexAttribBinding(j));
-	    }
-
-        osg::ref_ptr<osg::Geometry> right = new osg::Geometry;
-        right->setStateSet(geometry->getStateSet());
-        osg::ref_ptr<osg::DrawElementsUInt> rightDrawElements = new osg::DrawElementsUInt(GL_TRIANGLES);
-        rightDrawElements->reserve(drawElements->size() / 2);
-        right->addPrimitiveSet(rightDrawElements);
-        std::map<unsigned int, unsigned int> rightIndicesMapping;
-        right->setVertexArray(rightVertices);
-        right->setNormalArray(rightNormals);
-        right->setNormalBinding(geometry->getNormalBinding());
-        right->setColorArray(rightColors);
-        right->setColorBinding(geometry->getColorBinding());
-        right->setSecondaryColorArray(rightSecondaryColors);
-        right->setSecondaryColorBinding(geometry->getSecondaryColorBinding());
-        right->setFogCoordArray(rightFogCoords);
-	    right->setFogCoordBinding(geometry->getFogCoordBinding());
-        for (size_t j = 0; j < rightTexCoords.size(); ++j)
-	    {
-            if (!rightTexCoords[j]) { continue; }
-            right->setTexCoordArray(j, rightTexCoords[j]);
-	    }
-        for (size_t j = 0; j < rightVertexAttribs.size(); ++j)
-	    {
-		    if (!rightVertexAttribs[j]) { continue; }
-            right->setVertexAttribArray(j, rightVertexAttribs[j]);
-		    right->setVertexAttribBinding(j, geometry->getVertexAttribBinding(j));
-	    }
-
-        // sort vertex array
-        osg::ref_ptr<osg::Vec3Array> originalVertices = static_cast<osg::Vec3Array*>(vertexArray.get());
-        osg::ref_ptr<osg::Vec3Array> sortedVertices = static_cast<osg::Vec3Array*>(vertexArray->clone(osg::CopyOp::DEEP_COPY_ALL));
-        sortByAxis(sortedVertices, splitAxis);
-
-        // find split position
-        float splitPosition = 0.0f;
-        switch(splitAxis)
-        {
-        case X_AXIS:
-            splitPosition = sortedVertices->at(sortedVertices->getNumElements() / 2).x();
-            break;
-        case Y_AXIS:
-            splitPosition = sortedVertices->at(sortedVertices->getNumElements() / 2).y();
-            break;
-        case Z_AXIS:
-            splitPosition = sortedVertices->at(sortedVertices->getNumElements() / 2).z();
-            break;
-        }
+        // unknown vertex format, keep the geometry
+        m_triangles = NULL;
+        return std::unique_ptr<SplitNode>();
+    }
 
-        VectorCompare<osg::Vec3> compare(splitAxis);
+    m_triangleOrder.resize(m_triangles->size() / 3);
+    for (size_t i = 0; i < m_triangleOrder.size(); ++i) { m_triangleOrder[i] = i; }
 
-        // sort triangles in left or right geometry depending on their vertices
-        for (size_t i = 0 ; i < drawElements->size(); i+=3)
-        {
-            unsigned int indices[3] = { drawElements->at(i),
-                                        drawElements->at(i+1),
-                                        drawElements->at(i+2) };
-
-            unsigned int inLeft = 0, inRight = 0;
-            for (size_t j = 0; j < 3; ++j)
-            {
-                if (compare(originalVertices->at(indices[j]), osg::Vec3(splitPosition, splitPosition, splitPosition)))
-                {
-                    ++inLeft;
-                } else {
-                    ++inRight;
-                }
-            }
-
-            // chose left or right geometry depending on the number of vertices that fit in the bucket
-            if (inLeft > inRight)
-            {
-                // check if we need to add vertices
-                for (size_t j = 0; j < 3; ++j)
-                {
-                    auto it = leftIndicesMapping.find(indices[j]);
-
-                    if (it == leftIndicesMapping.end())
-                    {
-                        // add a new vertex
-                        leftIndicesMapping[indices[j]] = leftVertices->getNumElements();
-
-                        addElementTo(leftVertices, vertexArray, indices[j]);
-                        addElementTo(leftNormals, normalArray, indices[j]);
-                        addElementTo(leftColors, colorArray, indices[j]);
-                        addElementTo(leftSecondaryColors, secondaryColorArray, indices[j]);
-                        addElementTo(leftFogCoords, fogCoordArray, indices[j]);
-                        for (size_t k = 0; k < leftTexCoords.size(); ++k)
-                        {
-                            addElementTo(leftTexCoords[k], texCoordArrays[k], indices[j]);
-                        }
-                        for (size_t k = 0; k < leftVertexAttribs.size(); ++k)
-                        {
-                            addElementTo(leftVertexAttribs[k], vertexAttribArrays[k], indices[j]);
-                        }
-                    }
-                }
-
-                // add triangle with mapped indices
-                leftDrawElements->push_back(leftIndicesMapping[indices[0]]);
-                leftDrawElements->push_back(leftIndicesMapping[indices[1]]);
-                leftDrawElements->push_back(leftIndicesMapping[indices[2]]);
-            } else {
-                // check if we need to add vertices
-                for (size_t j = 0; j < 3; ++j)
-                {
-                    auto it = rightIndicesMapping.find(indices[j]);
-
-                    if (it == rightIndicesMapping.end())
-                    {
-                        // add a new vertex
-                        rightIndicesMapping[indices[j]] = rightVertices->getNumElements();
-
-                        addElementTo(rightVertices, vertexArray, indices[j]);
-                        addElementTo(rightNormals, normalArray, indices[j]);
-                        addElementTo(rightColors, colorArray, indices[j]);
-                        addElementTo(rightSecondaryColors, secondaryColorArray, indices[j]);
-                        addElementTo(rightFogCoords, fogCoordArray, indices[j]);
-                        for (size_t k = 0; k < rightTexCoords.size(); ++k)
-                        {
-                            addElementTo(rightTexCoords[k], texCoordArrays[k], indices[j]);
-                        }
-                        for (size_t k = 0; k < rightVertexAttribs.size(); ++k)
-                        {
-                            addElementTo(rightVertexAttribs[k], vertexAttribArrays[k], indices[j]);
-                        }
-                    }
-                }
-
-                // add triangle with mapped indices
-                rightDrawElements->push_back(rightIndicesMapping[indices[0]]);
-                rightDrawElements->push_back(rightIndicesMapping[indices[1]]);
-                rightDrawElements->push_back(rightIndicesMapping[indices[2]]);
-            }
-        }
+    // every leaf gathers all arrays of the geometry
+    m_arrayGather.reset(new osgUtil::ArrayGather(*geometry));
+
+    std::unique_ptr<SplitNode> root(new SplitNode);
+    splitTriangles(0, m_triangleOrder.size(), osgUtil::resolveNumThreads(m_numThreads), root.get());
+
+    // release the state of this geometry
+    m_triangles = NULL;
+    m_centroids.clear();
+    m_triangleOrder.clear();
+    m_arrayGather.reset();
 
-        // recursivly split them again
-        std::vector<osg::ref_ptr<osg::Drawable> > temp1 = splitGeometry(left, (Axis)((splitAxis + 1) % 3));
-        std::vector<osg::ref_ptr<osg::Drawable> > temp2 = splitGeometry(right, (Axis)((splitAxis + 1) % 3));
-       
-        geometries.insert(geometries.end(), temp1.begin(), temp1.end());
-        geometries.insert(geometries.end(), temp2.begin(), temp2.end());
+    return root;
+}
+
+osg::ref_ptr<osg::Geometry> KdTreeVisitor::createGeometry(const Leaf& leaf, osg::ref_ptr<osg::Geometry> geometry) const
+{
+    // geometries are created on the visitor's thread, they register as parents of the shared state set
+    osg::ref_ptr<osg::Geometry> splitGeometry = new osg::Geometry;
+    splitGeometry->setStateSet(geometry->getStateSet());
+    splitGeometry->addPrimitiveSet(leaf.drawElements);
+
+    // the gathered arrays keep the binding of their source
+    osgUtil::ArrayGather(*geometry).setArrays(*splitGeometry, leaf.arrays);
+
+    return splitGeometry;
+}
+
+void KdTreeVisitor::collectGeometries(const SplitNode& node, osg::ref_ptr<osg::Geometry> geometry, std::vector<osg::ref_ptr<osg::Drawable> >* geometries) const
+{
+    if (!node.children[0])
+    {
+        geometries->push_back(createGeometry(node.leaf, geometry));
+        return;
     }
 
-    return geometries;
+    collectGeometries(*node.children[0], geometry, geometries);
+    collectGeometries(*node.children[1], geometry, geometries);
 }
 
-template<class VertexArray, class Vector> void _sortByAxis(osg::ref_ptr<osg::Array> sortedVertices, KdTreeVisitor::Axis splitAxis)
+osg::ref_ptr<osg::Node> KdTreeVisitor::createHierarchy(const SplitNode& node, osg::ref_ptr<osg::Geometry> geometry) const
 {
-    osg::ref_ptr<VertexArray> vertices = dynamic_cast<VertexArray*>(sortedVertices.get());
+    if (!node.children[0])
+    {
+        osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+        geode->addDrawable(createGeometry(node.leaf, geometry));
+        return geode;
+    }
 
-    if (!vertices) { return; }
-    
-    std::sort(vertices->begin(), vertices->end(), VectorCompare<Vector>(splitAxis));
+    // the bounds of a group enclose the bounds of its two halves, which don't overlap much because they are split at the median
+    osg::ref_ptr<osg::Group> group = new osg::Group;
+    group->addChild(createHierarchy(*node.children[0], geometry));
+    group->addChild(createHierarchy(*node.children[1], geometry));
+    return group;
 }
 
+void KdTreeVisitor::splitTriangles(size_t begin, size_t end, unsigned int numThreads, SplitNode* node)
+{
+    // find the vertices used by the triangles
+    std::vector<unsigned int> vertices;
+    vertices.reserve(3 * (end - begin));
+    for (size_t i = begin; i < end; ++i)
+    {
+        const unsigned int* triangle = &m_triangles->front() + 3 * m_triangleOrder[i];
+        vertices.insert(vertices.end(), triangle, triangle + 3);
+    }
+    std::sort(vertices.begin(), vertices.end());
+    vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+    if (vertices.size() <= m_maxVertices || end - begin <= 1)
+    {
+        // the triangles are small enough, stop the recursion
+        node->leaf = createLeaf(begin, end, vertices);
+        return;
+    }
+    vertices.clear();
+    vertices.shrink_to_fit();
+
+    // split at the median centroid of the longest axis, only the order of the triangles in this range changes
+    osg::BoundingBox bounds;
+    for (size_t i = begin; i < end; ++i) { bounds.expandBy(m_centroids[m_triangleOrder[i]]); }
+    osg::Vec3 extent = bounds._max - bounds._min;
+    Axis splitAxis = (extent.x() >= extent.y() && extent.x() >= extent.z()) ? X_AXIS : ((extent.y() >= extent.z()) ? Y_AXIS : Z_AXIS);
+
+    size_t middle = begin + (end - begin) / 2;
+    std::nth_element(m_triangleOrder.begin() + begin, m_triangleOrder.begin() + middle, m_triangleOrder.begin() + end,
+                     CentroidCompare(m_centroids, splitAxis));
+
+    // the halves are independent, split them on two threads while there are threads left
+    node->children[0].reset(new SplitNode);
+    node->children[1].reset(new SplitNode);
+    size_t ranges[3] = { begin, middle, end };
+    unsigned int halfThreads[2] = { (numThreads + 1) / 2, std::max(1u, numThreads / 2) };
+    osgUtil::parallelFor(2, (numThreads > 1) ? 2 : 1, [&](size_t i)
+    {
+        splitTriangles(ranges[i], ranges[i+1], halfThreads[i], node->children[i].get());
+    });
+}
 
-void KdTreeVisitor::sortByAxis(osg::ref_ptr<osg::Array> sortedVertices, Axis splitAxis)
+KdTreeVisitor::Leaf KdTreeVisitor::createLeaf(size_t begin, size_t end, const std::vector<unsigned int>& vertices) const
 {
-    switch(sortedVertices->getType())
-	{
-        case osg::Array::Vec3ArrayType:
-		{
-			_sortByAxis<osg::Vec3Array, osg::Vec3>(sortedVertices, splitAxis);
-		} break;
-		case osg::Array::Vec3dArrayType:
-		{
-			_sortByAxis<osg::Vec3dArray, osg::Vec3d>(sortedVertices, splitAxis);
-		} break;
-		case osg::Array::Vec3bArrayType:
-		{
-			_sortByAxis<osg::Vec3bArray, osg::Vec3b>(sortedVertices, splitAxis);
-		} break;
-		case osg::Array::Vec3sArrayType:
-		{
-			_sortByAxis<osg::Vec3sArray, osg::Vec3s>(sortedVertices, splitAxis);
-		} break;
-		default:
-			// unknown vertex format
-			break;
-	}
+    Leaf leaf;
+
+    // vertices are sorted, so the new index of a vertex is its position in the list
+    leaf.drawElements = new osg::DrawElementsUInt(GL_TRIANGLES);
+    leaf.drawElements->reserve(3 * (end - begin));
+    for (size_t i = begin; i < end; ++i)
+    {
+        const unsigned int* triangle = &m_triangles->front() + 3 * m_triangleOrder[i];
+        for (int j = 0; j < 3; ++j)
+        {
+            leaf.drawElements->push_back(std::lower_bound(vertices.begin(), vertices.end(), triangle[j]) - vertices.begin());
+        }
+    }
+
+    leaf.arrays = m_arrayGather->gather(vertices);
+
+    return leaf;
 }
 
 template<class VertexArray, class Vector> void _collectTriangles(osg::ref_ptr<osg::Geometry> geometry, osg::ref_ptr<osg::DrawElementsUInt> drawElements)
@@ -354,7 +256,7 @@ template<class VertexArray, class Vector> void _collectTriangles(osg::ref_ptr<os
 
 	for (size_t i = 0; i < geometry->getNumPrimitiveSets(); ++i)
 	{
-		geometry->getPrimitiveSet(i)->accept(triangleCollector);		
+		geometry->getPrimitiveSet(i)->accept(triangleCollector);
 	}
 }
 
@@ -388,172 +290,49 @@ osg::ref_ptr<osg::DrawElementsUInt> KdTreeVisitor::collectTriangles(osg::ref_ptr
     return drawElements;
 }
 
-osg::ref_ptr<osg::Array> KdTreeVisitor::createArrayOfType(osg::ref_ptr<osg::Array> rhs)
-{
-    if (rhs == NULL)
-		return NULL;
-
-	switch (rhs->getType())
-	{
-    case osg::Array::ByteArrayType:
-		return new osg::ByteArray();
-		break;
-	case osg::Array::ShortArrayType:
-		return new osg::ShortArray();
-		break;
-	case osg::Array::IntArrayType:
-		return new osg::IntArray();
-		break;
-	case osg::Array::UByteArrayType:
-		return new osg::UByteArray();
-		break;
-	case osg::Array::UShortArrayType:
-		return new osg::UShortArray();
-		break;
-	case osg::Array::UIntArrayType:
-		return new osg::UIntArray();
-		break;
-	case osg::Array::Vec4ubArrayType:
-		return new osg::Vec4ubArray();
-		break;
-	case osg::Array::FloatArrayType:
-		return new osg::FloatArray();
-		break;
-	case osg::Array::Vec2ArrayType:
-		return new osg::Vec2Array();
-		break;
-	case osg::Array::Vec3ArrayType:
-		return new osg::Vec3Array();
-		break;
-	case osg::Array::Vec4ArrayType:
-		return new osg::Vec4Array();
-		break;
-	case osg::Array::Vec2sArrayType:
-		return new osg::Vec2sArray();
-		break;
-	case osg::Array::Vec3sArrayType:
-		return new osg::Vec3sArray();
-		break;
-	case osg::Array::Vec4sArrayType:
-		return new osg::Vec4sArray();
-		break;
-    case osg::Array::Vec2bArrayType:
-		return new osg::Vec2bArray();
-		break;
-	case osg::Array::Vec3bArrayType:
-		return new osg::Vec3bArray();
-		break;
-	case osg::Array::Vec4bArrayType:
-		return new osg::Vec4bArray();
-		break;
-    case osg::Array::DoubleArrayType:
-		return new osg::DoubleArray();
-		break;
-	case osg::Array::Vec2dArrayType:
-		return new osg::Vec2dArray();
-		break;
-	case osg::Array::Vec3dArrayType:
-		return new osg::Vec3dArray();
-		break;
-	case osg::Array::Vec4dArrayType:
-		return new osg::Vec4dArray();
-		break;  
-	case osg::Array::MatrixArrayType:
-		return new osg::MatrixfArray();
-		break;
-	default:
-		return NULL;
-		break;
-	}
-}
-
-template<class ArrayType> void _addElementTo(osg::ref_ptr<osg::Array> dst, osg::ref_ptr<osg::Array> src, size_t element)
+template<class VertexArray> void _collectCentroids(osg::ref_ptr<osg::Array> vertexArray, const osg::DrawElementsUInt& triangles, std::vector<osg::Vec3>* centroids)
 {
-	// cast the arrays to the right type
-	ArrayType* source = dynamic_cast<ArrayType*>(src.get());
-	ArrayType* destination = dynamic_cast<ArrayType*>(dst.get());
+    const VertexArray& vertices = *static_cast<VertexArray*>(vertexArray.get());
 
-	destination->push_back(source->at(element));
+    centroids->resize(triangles.size() / 3);
+    for (size_t i = 0; i < centroids->size(); ++i)
+    {
+        osg::Vec3 centroid;
+        for (int j = 0; j < 3; ++j)
+        {
+            const typename VertexArray::ElementDataType& vertex = vertices[triangles[3 * i + j]];
+            centroid += osg::Vec3(vertex.x(), vertex.y(), vertex.z());
+        }
+        (*centroids)[i] = centroid / 3.0f;
+    }
 }
 
-void KdTreeVisitor::addElementTo(osg::ref_ptr<osg::Array> dst, osg::ref_ptr<osg::Array> src, size_t element)
+bool KdTreeVisitor::collectCentroids(osg::ref_ptr<osg::Array> vertexArray)
 {
-	// assert that we have an source and destination array, that they have the same type and we access an existing element
-	if (!dst || ! src) { return; }
-	if (dst->getType() != src->getType()) { return; }
-	if (element >= src->getNumElements()) { return; }
-
-	switch(src->getType())
+    switch(vertexArray->getType())
 	{
-	case osg::Array::ByteArrayType:
-		_addElementTo<osg::ByteArray>(dst, src, element);
-		break;
-	case osg::Array::ShortArrayType:
-		_addElementTo<osg::ShortArray>(dst, src, element);
-		break;
-	case osg::Array::IntArrayType:
-		_addElementTo<osg::IntArray>(dst, src, element);
-		break;
-	case osg::Array::UByteArrayType:
-		_addElementTo<osg::UByteArray>(dst, src, element);
-		break;
-	case osg::Array::UShortArrayType:
-		_addElementTo<osg::UShortArray>(dst, src, element);
-		break;
-	case osg::Array::UIntArrayType:
-		_addElementTo<osg::UIntArray>(dst, src, element);
-		break;
-	case osg::Array::Vec4ubArrayType:
-		_addElementTo<osg::Vec4ubArray>(dst, src, element);
-		break;
-	case osg::Array::FloatArrayType:
-		_addElementTo<osg::FloatArray>(dst, src, element);
-		break;
-	case osg::Array::Vec2ArrayType:
-		_addElementTo<osg::Vec2Array>(dst, src, element);
-		break;
-	case osg::Array::Vec3ArrayType:
-		_addElementTo<osg::Vec3Array>(dst, src, element);
-		break;
-	case osg::Array::Vec4ArrayType:
-		_addElementTo<osg::Vec4Array>(dst, src, element);
-		break;
-	case osg::Array::Vec2sArrayType:
-		_addElementTo<osg::Vec2sArray>(dst, src, element);
-		break;
-	case osg::Array::Vec3sArrayType:
-		_addElementTo<osg::Vec3sArray>(dst, src, element);
-		break;
-	case osg::Array::Vec4sArrayType:
-		_addElementTo<osg::Vec4sArray>(dst, src, element);
-		break;
-    case osg::Array::Vec2bArrayType:
-		_addElementTo<osg::Vec2bArray>(dst, src, element);
-		break;
-	case osg::Array::Vec3bArrayType:
-		_addElementTo<osg::Vec3bArray>(dst, src, element);
-		break;
-	case osg::Array::Vec4bArrayType:
-		_addElementTo<osg::Vec4bArray>(dst, src, element);
-		break;
-    case osg::Array::DoubleArrayType:
-		_addElementTo<osg::DoubleArray>(dst, src, element);
-		break;
-	case osg::Array::Vec2dArrayType:
-		_addElementTo<osg::Vec2dArray>(dst, src, element);
-		break;
-	case osg::Array::Vec3dArrayType:
-		_addElementTo<osg::Vec3dArray>(dst, src, element);
-		break;
-	case osg::Array::Vec4dArrayType:
-		_addElementTo<osg::Vec4dArray>(dst, src, element);
-		break;  
-	case osg::Array::MatrixArrayType:
-		_addElementTo<osg::MatrixfArray>(dst, src, element);
-		break;
+        case osg::Array::Vec3ArrayType:
+		{
+			_collectCentroids<osg::Vec3Array>(vertexArray, *m_triangles, &m_centroids);
+		} break;
+		case osg::Array::Vec3dArrayType:
+		{
+			_collectCentroids<osg::Vec3dArray>(vertexArray, *m_triangles, &m_centroids);
+		} break;
+		case osg::Array::Vec3bArrayType:
+		{
+			_collectCentroids<osg::Vec3bArray>(vertexArray, *m_triangles, &m_centroids);
+		} break;
+		case osg::Array::Vec3sArrayType:
+		{
+			_collectCentroids<osg::Vec3sArray>(vertexArray, *m_triangles, &m_centroids);
+		} break;
+		default:
+			// unknown vertex format
+			return false;
 	}
-}
-
 
+    return true;
+}
 
-}
\ No newline at end of file
+}
@@ -6,32 +6,77 @@
 #include <osg/ref_ptr>
 #include <osg/NodeVisitor>
 #include <osg/Geometry>
+#include <osg/Group>
+
+#include "ArrayGather.h"
 
 namespace osgExample {
 
 class KdTreeVisitor : public osg::NodeVisitor {
 public:
-    KdTreeVisitor(unsigned int maxVertices=65536u)
+    /**
+     @param maxVertices maximum number of vertices of a split geometry
+     @param numThreads threads that split both halves of a geometry in parallel, 0 uses one thread per core
+    */
+    KdTreeVisitor(unsigned int maxVertices=65536u, unsigned int numThreads=1u)
         : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN)
         , m_maxVertices(maxVertices)
+        , m_numThreads(numThreads)
+        , m_outputHierarchy(false)
     {
     }
 
     virtual void apply(osg::Geode& geode);
-    
+
+    /**
+     @brief replaces split geodes with a group tree that mirrors the splits instead of adding all split geometries to the geode.
+     Every split geometry gets its own geode at the bottom of the tree, so whole regions can be culled at once.
+     Geodes without parents are always split into a flat list.
+    */
+    inline void setOutputHierarchy(bool outputHierarchy) { m_outputHierarchy = outputHierarchy; }
+    inline bool getOutputHierarchy() const { return m_outputHierarchy; }
+
     enum Axis {
         X_AXIS = 0,
         Y_AXIS = 1,
         Z_AXIS = 2
     };
 private:
-    std::vector<osg::ref_ptr<osg::Drawable> > splitGeometry(osg::ref_ptr<osg::Geometry> geometry, Axis splitAxis=X_AXIS);
-    void sortByAxis(osg::ref_ptr<osg::Array> sortedVertices, Axis splitAxis);
+    /**
+     @brief triangles and vertices of one split geometry, gathered from the arrays of the original geometry
+    */
+    struct Leaf {
+        std::vector<osg::ref_ptr<osg::Array> > arrays;
+        osg::ref_ptr<osg::DrawElementsUInt> drawElements;
+    };
+
+    /**
+     @brief node of the split tree, either a leaf or split into two children
+    */
+    struct SplitNode {
+        Leaf leaf;
+        std::unique_ptr<SplitNode> children[2];
+    };
+
+    std::unique_ptr<SplitNode> buildSplitTree(osg::ref_ptr<osg::Geometry> geometry);
+    void splitTriangles(size_t begin, size_t end, unsigned int numThreads, SplitNode* node);
+    Leaf createLeaf(size_t begin, size_t end, const std::vector<unsigned int>& vertices) const;
+    osg::ref_ptr<osg::Geometry> createGeometry(const Leaf& leaf, osg::ref_ptr<osg::Geometry> geometry) const;
+    void collectGeometries(const SplitNode& node, osg::ref_ptr<osg::Geometry> geometry, std::vector<osg::ref_ptr<osg::Drawable> >* geometries) const;
+    osg::ref_ptr<osg::Node> createHierarchy(const SplitNode& node, osg::ref_ptr<osg::Geometry> geometry) const;
     osg::ref_ptr<osg::DrawElementsUInt> collectTriangles(osg::ref_ptr<osg::Geometry> geometry);
-    osg::ref_ptr<osg::Array> createArrayOfType(osg::ref_ptr<osg::Array> rhs);
-	void addElementTo(osg::ref_ptr<osg::Array> dst, osg::ref_ptr<osg::Array> src, size_t element);
+    bool collectCentroids(osg::ref_ptr<osg::Array> vertexArray);
 
     unsigned int m_maxVertices;
+    unsigned int m_numThreads;
+    bool m_outputHierarchy;
+
+    // state of the geometry that is split at the moment, shared read only by all threads except m_triangleOrder,
+    // which the threads only reorder within their own range
+    osg::ref_ptr<osg::DrawElementsUInt> m_triangles;
+    std::vector<osg::Vec3> m_centroids;
+    std::vector<unsigned int> m_triangleOrder;
+    std::unique_ptr<osgUtil::ArrayGather> m_arrayGather;
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,177 @@
+#include "MeshletDrawElements.h"
+#include "GLFunctions.h"
+
+#include <atomic>
+#include <mutex>
+
+#include <osg/State>
+#include <osg/Geometry>
+#include <osg/CullFace>
+#include <osg/Camera>
+#include <osg/RenderInfo>
+#include <osgUtil/CullVisitor>
+
+namespace osgExample {
+
+static std::atomic<unsigned int> s_numCulledTriangles(0);
+
+unsigned int MeshletDrawElements::resetNumCulledTriangles()
+{
+    return s_numCulledTriangles.exchange(0);
+}
+
+// the camera the draw traversal of this thread draws for, set by MeshletDrawCallback around the draw of a geometry
+static thread_local const osg::Camera* s_drawCamera = NULL;
+
+void MeshletDrawElements::addMeshlet(const Meshlet& meshlet)
+{
+    m_meshlets.push_back(meshlet);
+}
+
+unsigned int MeshletDrawElements::cullMeshlets(osgUtil::CullVisitor* cv, bool cullBackFaces)
+{
+    // the culling set of the visitor is in the local coordinates of the geometry, like the meshlet bounds
+    osg::Vec3 eye = cv->getEyeLocal();
+    unsigned int numCulledTriangles = 0;
+
+    std::vector<unsigned int> visibleMeshlets;
+    for (size_t i = 0; i < m_meshlets.size(); ++i)
+    {
+        const Meshlet& meshlet = m_meshlets[i];
+
+        // back facing if the sphere lies completely in the cone of eye positions that see no front face
+        osg::Vec3 direction = meshlet.bounds.center() - eye;
+        bool backFacing = cullBackFaces && direction * meshlet.coneAxis >= meshlet.coneCutoff * direction.length() + meshlet.bounds.radius();
+
+        if (backFacing || cv->isCulled(meshlet.bounds))
+        {
+            numCulledTriangles += meshlet.count / 3;
+        } else {
+            visibleMeshlets.push_back(i);
+        }
+    }
+    s_numCulledTriangles += numCulledTriangles;
+
+    // every camera culls and draws with its own list, cameras may cull the same geometry on different threads
+    unsigned int numVisibleMeshlets = visibleMeshlets.size();
+    std::lock_guard<std::mutex> lock(m_visibleMeshletsMutex);
+    m_visibleMeshlets[cv->getCurrentCamera()].swap(visibleMeshlets);
+
+    return numVisibleMeshlets;
+}
+
+void MeshletDrawElements::draw(osg::State& state, bool useVertexBufferObjects) const
+{
+    // glMultiDrawElements is not exported by every GL library, every context loads its own
+    osg::GLFunctions::MultiDrawElementsProc glMultiDrawElementsProc = osg::GLFunctions::getFunctions(state.getContextID())->glMultiDrawElementsProc;
+
+    // the map nodes stay where they are while other cameras add their lists, the list of a camera only changes in its cull
+    const std::vector<unsigned int>* visibleMeshlets = NULL;
+    {
+        std::lock_guard<std::mutex> lock(m_visibleMeshletsMutex);
+        auto found = m_visibleMeshlets.find(s_drawCamera);
+        if (found != m_visibleMeshlets.end()) { visibleMeshlets = &found->second; }
+    }
+
+    if (empty() || (visibleMeshlets && visibleMeshlets->empty())) { return; }
+
+    const GLubyte* indices = reinterpret_cast<const GLubyte*>(&front());
+    if (useVertexBufferObjects)
+    {
+        osg::GLBufferObject* ebo = getOrCreateGLBufferObject(state.getContextID());
+        state.bindElementBufferObject(ebo);
+        if (ebo) { indices = reinterpret_cast<const GLubyte*>(ebo->getOffset(getBufferIndex())); }
+    }
+
+    // a camera that didn't cull the meshlets draws all of them
+    if (!visibleMeshlets)
+    {
+        glDrawElements(_mode, size(), GL_UNSIGNED_INT, indices);
+        return;
+    }
+
+    // merge neighbouring visible meshlets into one range
+    std::vector<GLsizei> drawCounts;
+    std::vector<const GLvoid*> drawIndices;
+    unsigned int end = 0;
+    for (auto i: *visibleMeshlets)
+    {
+        const Meshlet& meshlet = m_meshlets[i];
+        if (!drawCounts.empty() && meshlet.first == end)
+        {
+            drawCounts.back() += meshlet.count;
+        } else {
+            drawCounts.push_back(meshlet.count);
+            drawIndices.push_back(indices + meshlet.first * sizeof(GLuint));
+        }
+        end = meshlet.first + meshlet.count;
+    }
+
+    if (glMultiDrawElementsProc)
+    {
+        glMultiDrawElementsProc(_mode, &drawCounts.front(), GL_UNSIGNED_INT, &drawIndices.front(), drawCounts.size());
+    } else {
+        for (size_t i = 0; i < drawCounts.size(); ++i)
+        {
+            glDrawElements(_mode, drawCounts[i], GL_UNSIGNED_INT, drawIndices[i]);
+        }
+    }
+}
+
+/**
+ @brief whether the state a drawable is drawn with culls its back faces. The nearest state set that sets GL_CULL_FACE
+ decides if faces are culled, the nearest CullFace attribute which ones, by default the back faces.
+*/
+static bool cullsBackFaces(osgUtil::CullVisitor* cv, const osg::Drawable* drawable)
+{
+    // the state set of the drawable is pushed after its cull callback, the ones above it are in the state graph
+    std::vector<const osg::StateSet*> stateSets(1, drawable->getStateSet());
+    for (osgUtil::StateGraph* stateGraph = cv->getCurrentStateGraph(); stateGraph; stateGraph = stateGraph->_parent)
+    {
+        stateSets.push_back(stateGraph->getStateSet());
+    }
+
+    osg::StateAttribute::GLModeValue mode = osg::StateAttribute::INHERIT;
+    const osg::CullFace* cullFace = NULL;
+    for (auto stateSet: stateSets)
+    {
+        if (!stateSet) { continue; }
+        if (mode == osg::StateAttribute::INHERIT) { mode = stateSet->getMode(GL_CULL_FACE); }
+        if (!cullFace) { cullFace = dynamic_cast<const osg::CullFace*>(stateSet->getAttribute(osg::StateAttribute::CULLFACE)); }
+    }
+
+    return mode != osg::StateAttribute::INHERIT && (mode & osg::StateAttribute::ON) &&
+           (!cullFace || cullFace->getMode() != osg::CullFace::FRONT);
+}
+
+bool MeshletCullCallback::cull(osg::NodeVisitor* nv, osg::Drawable* drawable, osg::RenderInfo* renderInfo) const
+{
+    osgUtil::CullVisitor* cv = dynamic_cast<osgUtil::CullVisitor*>(nv);
+    osg::Geometry* geometry = drawable->asGeometry();
+
+    if (cv && geometry)
+    {
+        // the normal cones only tell which meshlets face away, that hides them only if back faces are culled
+        bool cullBackFaces = cullsBackFaces(cv, drawable);
+        bool visible = false;
+        for (size_t i = 0; i < geometry->getNumPrimitiveSets(); ++i)
+        {
+            MeshletDrawElements* meshletDrawElements = dynamic_cast<MeshletDrawElements*>(geometry->getPrimitiveSet(i));
+            visible |= meshletDrawElements ? meshletDrawElements->cullMeshlets(cv, cullBackFaces) > 0 : true;
+        }
+
+        return !visible;
+    }
+
+    return false;
+}
+
+void MeshletDrawCallback::drawImplementation(osg::RenderInfo& renderInfo, const osg::Drawable* drawable) const
+{
+    const osg::Camera* previousCamera = s_drawCamera;
+    s_drawCamera = renderInfo.getCurrentCamera();
+    drawable->drawImplementation(renderInfo);
+    s_drawCamera = previousCamera;
+}
+
+}
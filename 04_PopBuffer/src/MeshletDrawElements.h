@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <mutex>
+
+#include <osg/PrimitiveSet>
+#include <osg/Drawable>
+#include <osg/BoundingSphere>
+#include <osg/Vec3>
+
+namespace osg { class Camera; }
+namespace osgUtil { class CullVisitor; }
+
+namespace osgExample {
+
+/**
+ @brief Triangles drawn as small clusters, that are culled one by one against the view frustum and by their normal cone.
+ The indices of every meshlet are contiguous, the meshlets that survive culling are drawn with one glMultiDrawElements.
+ Functors see all triangles, culling only changes what is drawn.
+*/
+class MeshletDrawElements : public osg::DrawElementsUInt
+{
+public:
+    struct Meshlet {
+        unsigned int first;
+        unsigned int count;
+        osg::BoundingSphere bounds;
+        // all triangles face away from eyes inside the cone around -coneAxis with the cosine coneCutoff, 1 never culls
+        osg::Vec3 coneAxis;
+        float coneCutoff;
+    };
+
+    MeshletDrawElements()
+        : osg::DrawElementsUInt(GL_TRIANGLES)
+    {
+    }
+
+    MeshletDrawElements(const MeshletDrawElements& rhs, const osg::CopyOp& copyop=osg::CopyOp::SHALLOW_COPY)
+        : osg::DrawElementsUInt(rhs, copyop)
+        , m_meshlets(rhs.m_meshlets)
+    {
+    }
+
+    virtual osg::Object* cloneType() const { return new MeshletDrawElements(); }
+    virtual osg::Object* clone(const osg::CopyOp& copyop) const { return new MeshletDrawElements(*this, copyop); }
+    virtual bool isSameKindAs(const osg::Object* obj) const { return dynamic_cast<const MeshletDrawElements*>(obj)!=NULL; }
+    virtual const char* libraryName() const { return "osgExample"; }
+    virtual const char* className() const { return "MeshletDrawElements"; }
+
+    /** @brief appends a meshlet, its indices have to be added to the primitive set already */
+    void addMeshlet(const Meshlet& meshlet);
+    inline const std::vector<Meshlet>& getMeshlets() const { return m_meshlets; }
+
+    /**
+     @brief selects the meshlets that are inside the view frustum of the cull visitor and, if back faces are culled, face the eye.
+     The selection is kept per camera, the geometry has to be drawn through a MeshletDrawCallback to find it.
+     @return number of visible meshlets
+    */
+    unsigned int cullMeshlets(osgUtil::CullVisitor* cv, bool cullBackFaces);
+
+    virtual void draw(osg::State& state, bool useVertexBufferObjects) const;
+
+    /** @brief number of triangles rejected by meshlet culling since the last call */
+    static unsigned int resetNumCulledTriangles();
+protected:
+    virtual ~MeshletDrawElements() {}
+
+    std::vector<Meshlet> m_meshlets;
+    // the meshlets every camera selected in its last cull traversal
+    std::map<const osg::Camera*, std::vector<unsigned int> > m_visibleMeshlets;
+    mutable std::mutex m_visibleMeshletsMutex;
+};
+
+/**
+ @brief culls the meshlets of all MeshletDrawElements of a geometry, the geometry is culled if no meshlet is visible.
+ Meshlets facing away are only culled if the state of the geometry culls back faces.
+*/
+struct MeshletCullCallback : osg::Drawable::CullCallback
+{
+    virtual bool cull(osg::NodeVisitor* nv, osg::Drawable* drawable, osg::RenderInfo* renderInfo) const;
+};
+
+/**
+ @brief draws a geometry with the meshlets the current camera selected, several cameras may cull one geometry in a frame
+*/
+struct MeshletDrawCallback : osg::Drawable::DrawCallback
+{
+    virtual void drawImplementation(osg::RenderInfo& renderInfo, const osg::Drawable* drawable) const;
+};
+
+}
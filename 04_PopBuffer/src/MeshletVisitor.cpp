@@ -0,0 +1,165 @@
+#include "MeshletVisitor.h"
+#include "LevelOfDetailGeometry.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include <osg/Geode>
+#include <osg/BoundingBox>
+#include <osg/TriangleIndexFunctor>
+
+namespace osgExample {
+
+struct MeshletTriangleCollector
+{
+    osg::ref_ptr<osg::DrawElementsUInt> _drawElements;
+
+    void operator()(unsigned int pos1, unsigned int pos2, unsigned int pos3)
+    {
+        _drawElements->push_back(pos1);
+        _drawElements->push_back(pos2);
+        _drawElements->push_back(pos3);
+    }
+};
+
+/** @brief primitive sets that the triangle index functor turns into triangles */
+static bool isTriangleMode(GLenum mode)
+{
+    return mode == GL_TRIANGLES || mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN ||
+           mode == GL_QUADS || mode == GL_QUAD_STRIP || mode == GL_POLYGON;
+}
+
+void MeshletVisitor::apply(osg::Geode& geode)
+{
+    for (size_t i = 0; i < geode.getNumDrawables(); ++i)
+    {
+        // pop buffer geometries need their lod ranges, meshlets would reorder their triangles
+        osg::ref_ptr<osg::Geometry> geometry = dynamic_cast<osg::Geometry*>(geode.getDrawable(i));
+        if (!geometry || dynamic_cast<osg::LevelOfDetailGeometry*>(geometry.get()) ||
+            geometry->getCullCallback() || geometry->getDrawCallback()) { continue; }
+
+        osg::ref_ptr<MeshletDrawElements> drawElements = createMeshlets(geometry);
+        if (!drawElements) { continue; }
+
+        // points and lines are kept as they are
+        for (unsigned int j = geometry->getNumPrimitiveSets(); j > 0; --j)
+        {
+            if (isTriangleMode(geometry->getPrimitiveSet(j - 1)->getMode())) { geometry->removePrimitiveSet(j - 1); }
+        }
+        geometry->addPrimitiveSet(drawElements);
+
+        // the visible meshlets change every frame
+        geometry->setDataVariance(osg::Object::DYNAMIC);
+        geometry->setUseDisplayList(false);
+        geometry->setUseVertexBufferObjects(true);
+        geometry->setCullCallback(new MeshletCullCallback());
+        geometry->setDrawCallback(new MeshletDrawCallback());
+    }
+
+    traverse(geode);
+}
+
+osg::ref_ptr<MeshletDrawElements> MeshletVisitor::createMeshlets(osg::ref_ptr<osg::Geometry> geometry) const
+{
+    // bounds and cones are computed from float positions, other vertex formats are kept
+    osg::Vec3Array* vertices = dynamic_cast<osg::Vec3Array*>(geometry->getVertexArray());
+    if (!vertices || vertices->empty()) { return NULL; }
+
+    osg::TriangleIndexFunctor<MeshletTriangleCollector> triangleCollector;
+    triangleCollector._drawElements = new osg::DrawElementsUInt(GL_TRIANGLES);
+    for (size_t i = 0; i < geometry->getNumPrimitiveSets(); ++i)
+    {
+        if (isTriangleMode(geometry->getPrimitiveSet(i)->getMode())) { geometry->getPrimitiveSet(i)->accept(triangleCollector); }
+    }
+    const osg::DrawElementsUInt& triangles = *triangleCollector._drawElements;
+    if (triangles.empty()) { return NULL; }
+
+    // add triangles in their order until the next one would exceed the vertex or triangle limit,
+    // the triangles of the model are usually ordered well enough for compact meshlets
+    osg::ref_ptr<MeshletDrawElements> drawElements = new MeshletDrawElements();
+    drawElements->reserve(triangles.size());
+
+    std::vector<unsigned int> meshletOfVertex(vertices->size(), 0u);
+    std::vector<unsigned int> meshletVertices;
+    unsigned int meshlet = 1;
+    unsigned int first = 0;
+
+    for (size_t i = 0; i < triangles.size(); i += 3)
+    {
+        unsigned int newVertices = 0;
+        for (int j = 0; j < 3; ++j)
+        {
+            if (meshletOfVertex[triangles[i+j]] != meshlet) { ++newVertices; }
+        }
+
+        unsigned int numTriangles = (drawElements->size() - first) / 3;
+        if (meshletVertices.size() + newVertices > m_maxVertices || numTriangles + 1 > m_maxTriangles)
+        {
+            addMeshlet(*vertices, meshletVertices, first, drawElements);
+            meshletVertices.clear();
+            first = drawElements->size();
+            ++meshlet;
+        }
+
+        for (int j = 0; j < 3; ++j)
+        {
+            unsigned int index = triangles[i+j];
+            if (meshletOfVertex[index] != meshlet)
+            {
+                meshletOfVertex[index] = meshlet;
+                meshletVertices.push_back(index);
+            }
+            drawElements->push_back(index);
+        }
+    }
+    addMeshlet(*vertices, meshletVertices, first, drawElements);
+
+    return drawElements;
+}
+
+void MeshletVisitor::addMeshlet(const osg::Vec3Array& vertices, const std::vector<unsigned int>& meshletVertices,
+                                unsigned int first, osg::ref_ptr<MeshletDrawElements> drawElements) const
+{
+    MeshletDrawElements::Meshlet meshlet;
+    meshlet.first = first;
+    meshlet.count = drawElements->size() - first;
+
+    // sphere around the center of the bounding box
+    osg::BoundingBox box;
+    for (auto index: meshletVertices) { box.expandBy(vertices[index]); }
+    float radius = 0.0f;
+    for (auto index: meshletVertices) { radius = std::max(radius, (vertices[index] - box.center()).length()); }
+    meshlet.bounds = osg::BoundingSphere(box.center(), radius);
+
+    // the cone axis is the mean triangle normal, the cutoff follows from the normal with the largest angle to it
+    std::vector<osg::Vec3> normals;
+    osg::Vec3 axis;
+    for (unsigned int i = first; i < first + meshlet.count; i += 3)
+    {
+        const osg::Vec3& v0 = vertices[(*drawElements)[i]];
+        osg::Vec3 normal = (vertices[(*drawElements)[i+1]] - v0) ^ (vertices[(*drawElements)[i+2]] - v0);
+        if (normal.normalize() == 0.0f) { continue; }
+
+        normals.push_back(normal);
+        axis += normal;
+    }
+
+    meshlet.coneAxis = axis;
+    meshlet.coneCutoff = 1.0f;
+    if (axis.normalize() > 0.0f)
+    {
+        float minDot = 1.0f;
+        for (auto& normal: normals) { minDot = std::min(minDot, normal * axis); }
+
+        // normals spread over more than a half space can always face the eye
+        if (minDot > 0.0f)
+        {
+            meshlet.coneAxis = axis;
+            meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+        }
+    }
+
+    drawElements->addMeshlet(meshlet);
+}
+
+}
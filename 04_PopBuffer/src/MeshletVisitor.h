@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+#include <osg/ref_ptr>
+#include <osg/NodeVisitor>
+#include <osg/Geometry>
+
+#include "MeshletDrawElements.h"
+
+namespace osgExample {
+
+/**
+ @brief Splits the triangles of every geometry into meshlets, small clusters with a bounding sphere and a normal cone.
+ The vertex arrays stay untouched, only the triangle primitive sets are replaced by one MeshletDrawElements.
+*/
+class MeshletVisitor : public osg::NodeVisitor {
+public:
+    /**
+     @param maxVertices maximum number of distinct vertices of a meshlet
+     @param maxTriangles maximum number of triangles of a meshlet
+    */
+    MeshletVisitor(unsigned int maxVertices=64u, unsigned int maxTriangles=124u)
+        : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN)
+        , m_maxVertices(maxVertices)
+        , m_maxTriangles(maxTriangles)
+    {
+    }
+
+    virtual void apply(osg::Geode& geode);
+private:
+    osg::ref_ptr<MeshletDrawElements> createMeshlets(osg::ref_ptr<osg::Geometry> geometry) const;
+    void addMeshlet(const osg::Vec3Array& vertices, const std::vector<unsigned int>& meshletVertices,
+                    unsigned int first, osg::ref_ptr<MeshletDrawElements> drawElements) const;
+
+    unsigned int m_maxVertices;
+    unsigned int m_maxTriangles;
+};
+
+}
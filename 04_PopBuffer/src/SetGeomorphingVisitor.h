@@ -0,0 +1,34 @@
+#pragma once
+
+#include <osg/NodeVisitor>
+#include "LevelOfDetailGeometry.h"
+
+namespace osgExample
+{
+
+class SetGeomorphing : public osg::NodeVisitor
+{
+public:
+	SetGeomorphing(bool geomorphing)
+		: osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) 
+		, _geomorphing(geomorphing)
+	{
+	}
+
+	virtual void apply(osg::Geode& geode)
+	{
+		for (auto drawable: geode.getDrawableList())
+		{
+			osg::ref_ptr<osg::LevelOfDetailGeometry> lodGeometry = dynamic_cast<osg::LevelOfDetailGeometry*>(drawable.get());
+
+			if (lodGeometry)
+			{
+				lodGeometry->setGeomorphing(_geomorphing);
+			}
+		}
+	}
+protected:
+	bool _geomorphing;
+};
+
+}
@@ -26,12 +26,18 @@
 #include <cmath>
 #include <fstream>
 #include <sstream>
+#include <iostream>
 
 #include "LevelOfDetailGeometry.h"
+#include "InstancedLevelOfDetailGeometry.h"
 #include "ConvertToLevelOfDetailGeometryVisitor.h"
 #include "AddTextureUniformVisitor.h"
 #include "DemoEventHandler.h"
 #include "KdTreeVisitor.h"
+#include "ConversionBenchmark.h"
+#include "CreateInstancesVisitor.h"
+#include "MeshletVisitor.h"
+#include "TriangleBudgetCallback.h"
 
 // osg
 #include <osg/ref_ptr>
@@ -41,6 +47,7 @@
 #include <osgViewer/ViewerEventHandlers>
 #include <osgDB/ReadFile>
 #include <osgDB/WriteFile>
+#include <osgDB/FileNameUtils>
 #include <osg/CullFace>
 
 osg::Shader* loadShaderAndAddPrelude(const std::string& fileName, const std::string& uniformDefintion, const std::string& functionDefinition)
@@ -78,6 +85,34 @@ osg::Shader* loadShaderAndAddPrelude(const std::string& fileName, const std::str
 int main(int argc, char** argv)
 {
 	osg::ArgumentParser arguments(&argc, argv);
+
+	// measure conversion times of synthetic meshes and exit
+	if (arguments.read("--benchmark"))
+	{
+		std::vector<unsigned int> triangleCounts;
+		triangleCounts.push_back(100000);
+		triangleCounts.push_back(1000000);
+		triangleCounts.push_back(10000000);
+
+		osgExample::ConversionBenchmark benchmark(std::cout);
+
+		// verify the lods of a model and compare its vertex cache efficiency and load times if one is passed
+		bool valid = true;
+		if (arguments.argc() > 1)
+		{
+			osg::ref_ptr<osg::Node> model = osgDB::readNodeFile(arguments[1]);
+			if (model)
+			{
+				valid = benchmark.verifyLodLevels(model);
+				benchmark.compareCacheMissRatios(model);
+				benchmark.compareLoadTimes(model);
+			}
+		}
+
+		valid = benchmark.run(triangleCounts) && valid;
+		return valid ? 0 : -1;
+	}
+
 	osg::ref_ptr<osgViewer::Viewer> viewer = new osgViewer::Viewer;
 
 	viewer->setUpViewInWindow(100, 100, 800, 600);
@@ -94,7 +129,11 @@ int main(int argc, char** argv)
 
 	if (arguments.argc() > 1)
 	{
-        model = osgDB::readNodeFile(arguments[1]);
+        // progressive pop files are read level by level, when the camera needs them
+        osg::ref_ptr<osgDB::Options> options = new osgDB::Options();
+        if (arguments.read("--progressive")) { options->setOptionString("progressive"); }
+
+        model = osgDB::readNodeFile(arguments[1], options);
         if (!model) { return -1; }
 
         scene->addChild(model, true);
@@ -102,19 +141,43 @@ int main(int argc, char** argv)
         std::string outputFile;
 		if (arguments.read("--convert", outputFile))
         {
+            // --compress stores 16 bit vertices, octahedral normals and half float texture coordinates
+            bool compress = arguments.read("--compress");
+
+            // pop files only store float vertices, normals and texture coordinates, the writer would skip every mesh
+            if (compress && osgDB::getLowerCaseFileExtension(outputFile) == "pop")
+            {
+                std::cout << "Error: --compress can not be written to .pop files, they only store uncompressed attributes" << std::endl;
+                return -1;
+            }
+
             optimizedModel = dynamic_cast<osg::Node*>(model->clone(osg::CopyOp::DEEP_COPY_ALL)); 
             
+            // --threads splits and converts on several threads, 0 uses all cores
+            unsigned int numThreads = 1;
+            bool parallel = arguments.read("--threads", numThreads);
+
             // first split geometry with kd tree
 			int maxVertices = 0;
 			if (arguments.read("--optimize", maxVertices))
 			{
-				osgExample::KdTreeVisitor kdVisitor(maxVertices);
+				// --hierarchy keeps the splits as a group tree, so regions can be culled at once
+				osgExample::KdTreeVisitor kdVisitor(maxVertices, numThreads);
+				kdVisitor.setOutputHierarchy(arguments.read("--hierarchy"));
 				optimizedModel->accept(kdVisitor);
 			}
 
             // convert geometry if requested
             osgUtil::ConvertToLevelOfDetailGeometryVisitor lodVisitor;
-	        optimizedModel->accept(lodVisitor);
+            lodVisitor.setCompressAttributes(compress);
+            if (parallel)
+            {
+                lodVisitor.convertParallel(*optimizedModel, numThreads);
+            } else {
+                // the chunks of the kd tree share the grid of their compressed vertices, so their seams stay closed
+                if (lodVisitor.getCompressAttributes()) { lodVisitor.computeCompressionGrid(*optimizedModel); }
+	            optimizedModel->accept(lodVisitor);
+            }
 			osgDB::writeNodeFile(*optimizedModel, outputFile);
 
             scene->setValue(0, false);
@@ -185,12 +248,33 @@ int main(int argc, char** argv)
         scene->addChild(geode, true);
 	}	
 
+	// draw the original model as meshlets, that are culled by their bounds and normal cones
+	if (model && arguments.read("--meshlets"))
+	{
+		osgExample::MeshletVisitor meshletVisitor;
+		model->accept(meshletVisitor);
+
+		// the normal cones only cull with back face culling, --cull-back-faces enables it for closed models
+		if (arguments.read("--cull-back-faces"))
+		{
+			model->getOrCreateStateSet()->setAttributeAndModes(new osg::CullFace(osg::CullFace::BACK), osg::StateAttribute::ON);
+		}
+	}
+
 	osg::BoundingSphere bs = scene->getBound();
 
     // add overal uniforms
     AddTextureUniformVisitor textureVisitor;
     scene->accept(textureVisitor);   
 
+    // draw every pop buffer geometry as a grid of instances, each with its own lod
+    unsigned int numInstances = 0;
+    if (arguments.read("--instances", numInstances) && numInstances > 0)
+    {
+        osgExample::CreateInstances instancesVisitor(numInstances);
+        optimizedModel->accept(instancesVisitor);
+    }
+
     osg::Uniform* lightDirection = new osg::Uniform(osg::Uniform::FLOAT_VEC4, "lightDirection", 3);
     lightDirection->setElement(0, osg::Vec4(1.0f, 0.0f, 1.0f, 0.0f));
     lightDirection->setElement(1, osg::Vec4(-1.0f, 0.0f, 1.0f, 0.0f));
@@ -209,12 +293,17 @@ int main(int argc, char** argv)
 
     {
 	    osg::ref_ptr<osg::Program> program = new osg::Program();
-        osg::ref_ptr<osg::Shader> vertexShader = loadShaderAndAddPrelude("../shader/popbuffer.vert",
-                                                                         osg::LevelOfDetailGeometry::getVertexShaderUniformDefintion(),
-                                                                         osg::LevelOfDetailGeometry::getVertexShaderFunctionDefinition());
+        osg::ref_ptr<osg::Shader> vertexShader = (numInstances > 0) ?
+            loadShaderAndAddPrelude("../shader/popbuffer_instanced.vert",
+                                    osg::InstancedLevelOfDetailGeometry::getVertexShaderUniformDefintion(),
+                                    osg::InstancedLevelOfDetailGeometry::getVertexShaderFunctionDefinition()) :
+            loadShaderAndAddPrelude("../shader/popbuffer.vert",
+                                    osg::LevelOfDetailGeometry::getVertexShaderUniformDefintion(),
+                                    osg::LevelOfDetailGeometry::getVertexShaderFunctionDefinition());
         osg::ref_ptr<osg::Shader> fragmentShader = osgDB::readShaderFile("../shader/popbuffer.frag");
 	    program->addShader(vertexShader);
 	    program->addShader(fragmentShader);
+	    osg::LevelOfDetailGeometry::addPackedAttributeBindings(program);
     
         osg::ref_ptr<osg::StateSet> ss = optimizedModel->getOrCreateStateSet();
         ss->setDataVariance(osg::Object::DYNAMIC);
@@ -227,8 +316,29 @@ int main(int argc, char** argv)
         ss->addUniform(visualizeLodUniform);
 
 	    viewer->addEventHandler(new osgGA::StateSetManipulator(viewer->getCamera()->getOrCreateStateSet()));
-	    viewer->addEventHandler(new osgViewer::StatsHandler());
-        viewer->addEventHandler(new osgExample::DemoEventHandler(scene, visualizeLodUniform, textureActiveUniform));
+	    osg::ref_ptr<osgViewer::StatsHandler> statsHandler = new osgViewer::StatsHandler();
+	    statsHandler->addUserStatsLine("Lod transitions", osg::Vec4(0.7f, 0.7f, 0.7f, 1.0f), osg::Vec4(0.7f, 0.7f, 0.7f, 0.5f),
+	                                   "Pop lod transitions", 1.0, true, false, "", "", 100.0);
+	    statsHandler->addUserStatsLine("Culled triangles", osg::Vec4(0.7f, 0.7f, 0.7f, 1.0f), osg::Vec4(0.7f, 0.7f, 0.7f, 0.5f),
+	                                   "Meshlet culled triangles", 1.0, true, false, "", "", 1000000.0);
+	    viewer->addEventHandler(statsHandler);
+
+        osg::ref_ptr<osgExample::DemoEventHandler> demoEventHandler = new osgExample::DemoEventHandler(scene, visualizeLodUniform, textureActiveUniform);
+        viewer->addEventHandler(demoEventHandler);
+
+        // choose the lods of all pop buffer geometries together, so that they draw at most the given number of triangles
+        unsigned int maxTriangles = 0;
+        if (arguments.read("--triangle-budget", maxTriangles) && maxTriangles > 0)
+        {
+            osg::ref_ptr<osg::TriangleBudgetCallback> triangleBudget = new osg::TriangleBudgetCallback(maxTriangles);
+            viewer->getCamera()->setCullCallback(triangleBudget);
+            demoEventHandler->setTriangleBudget(triangleBudget);
+
+            statsHandler->addUserStatsLine("Budget triangles", osg::Vec4(0.7f, 0.7f, 0.7f, 1.0f), osg::Vec4(0.7f, 0.7f, 0.7f, 0.5f),
+                                           "Pop budget triangles", 1.0, true, false, "", "", double(maxTriangles));
+            statsHandler->addUserStatsLine("Budget error [px]", osg::Vec4(0.7f, 0.7f, 0.7f, 1.0f), osg::Vec4(0.7f, 0.7f, 0.7f, 0.5f),
+                                           "Pop budget error", 1.0, true, false, "", "", 10.0);
+        }
     }
 
 	viewer->setSceneData(scene);